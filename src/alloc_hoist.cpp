@@ -0,0 +1,205 @@
+#include "alloc_hoist.h"
+#include "analysis.h"
+#include "cfg.h"
+#include "loop_analysis.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// the most elements an allocation may have to be hoisted. resetting an
+	// element in place takes about five L3 instructions, while allocating
+	// calls into the runtime, which costs tens of them, so only small
+	// aggregates are cheaper to reset
+	const int64_t max_reset_elements = 8;
+
+	// Returns the word indices the elements of an allocation take up, seen
+	// as a tuple, if its arguments are numbers and it is small enough to
+	// reset in place. Arrays keep their dimensions before the elements.
+	Opt<Pair<int64_t, int64_t>> get_element_words(InstructionInitializeArray &allocation, Variable *array) {
+		Vec<Uptr<Expr>> &args = allocation.get_declaration().get_args();
+		int64_t count = 1;
+		for (const Uptr<Expr> &arg : args) {
+			Opt<int64_t> number = get_number(arg);
+			if (!number || *number < 1 || *number % 2 == 0
+				|| __builtin_mul_overflow(count, *number >> 1, &count)
+				|| count > max_reset_elements)
+			{
+				return {};
+			}
+		}
+		int64_t first = array->get_type().get_a_type() == A_type::tuple ? 0 : args.size();
+		return Pair<int64_t, int64_t> { first, first + count };
+	}
+
+	// Returns whether the allocation at the given position can be moved out
+	// of the loop. It must be the only write to its variable in the loop,
+	// the variable must not be read before it in an iteration, and its
+	// dimensions must be small constants. It must also run in every
+	// iteration: either it is in the header, or the loop is counted, never
+	// returns from the function and has to go through it on the way to any
+	// latch.
+	bool can_hoist_allocation(
+		const cfg::Loop &loop,
+		const cfg::DominatorTree &dominators,
+		BasicBlock *bb,
+		int index,
+		const Liveness &liveness
+	) {
+		InstructionInitializeArray &allocation = static_cast<InstructionInitializeArray &>(*bb->get_inst()[index]);
+		Variable *array = *get_def(allocation);
+		if (find_loop_defs(loop, array) != Vec<Pair<BasicBlock *, int>> { { bb, index } }
+			|| liveness.live_in.at(loop.header).count(array)
+			|| !get_element_words(allocation, array))
+		{
+			return false;
+		}
+		if (bb == loop.header) {
+			return true;
+		}
+		for (BasicBlock *latch : loop.latches) {
+			if (!dominators.dominates(bb, latch)) {
+				return false;
+			}
+		}
+		for (BasicBlock *block : loop.blocks) {
+			if (block->get_terminator()->get_successor().empty()) {
+				return false;
+			}
+		}
+		return analyze_counted_loop(loop, dominators).has_value();
+	}
+
+	// Makes bb reset every element of the array to 1 (an encoded 0) and go
+	// on to next after. The elements are stored through a tuple view of the
+	// array, at the word indices in words, so each one costs a single store
+	// with no dimension sizes to load.
+	void reset_elements(IRFunction &ir_function, BasicBlock *bb, Variable *view, Pair<int64_t, int64_t> words, BasicBlock *next) {
+		auto make_ref = [](Variable *var) { return mkuptr<ItemRef<Variable>>(var); };
+		Type int64_type(A_type::int64, 0);
+		const std::string &name = view->get_name();
+		Variable *index = cfg::declare_variable(ir_function, name + "_index", int64_type);
+		Variable *condition = cfg::declare_variable(ir_function, name + "_condition", int64_type);
+		BasicBlock *header = cfg::insert_block_before(ir_function, next, name);
+		BasicBlock *latch = cfg::insert_block_before(ir_function, next, name + "_next");
+
+		bb->get_inst().push_back(mkuptr<InstructionAssignment>(make_ref(index), mkuptr<NumberLiteral>(words.first)));
+		bb->set_terminator(mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(header)));
+		header->get_inst().push_back(mkuptr<InstructionAssignment>(
+			make_ref(condition),
+			mkuptr<BinaryOperation>(make_ref(index), mkuptr<NumberLiteral>(words.second), Operator::lt)
+		));
+		header->set_terminator(mkuptr<TerminatorBranchTwo>(
+			make_ref(condition),
+			mkuptr<ItemRef<BasicBlock>>(latch),
+			mkuptr<ItemRef<BasicBlock>>(next)
+		));
+		Vec<Uptr<Expr>> location;
+		location.push_back(make_ref(index));
+		latch->get_inst().push_back(mkuptr<InstructionStore>(
+			mkuptr<MemoryLocation>(make_ref(view), mv(location)),
+			mkuptr<NumberLiteral>(1)
+		));
+		latch->get_inst().push_back(mkuptr<InstructionAssignment>(
+			make_ref(index),
+			mkuptr<BinaryOperation>(make_ref(index), mkuptr<NumberLiteral>(1), Operator::plus)
+		));
+		latch->set_terminator(mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(header)));
+	}
+
+	// Moves the allocation into the loop's preheader and resets the
+	// elements where it was. Unless the loop is known to run at least once, the allocation is only
+	// made if the header's test lets the loop in.
+	void hoist_allocation(
+		IRFunction &ir_function,
+		const cfg::Loop &loop,
+		const cfg::DominatorTree &dominators,
+		BasicBlock *bb,
+		int index
+	) {
+		Opt<CountedLoop> counted;
+		if (bb != loop.header) {
+			counted = analyze_counted_loop(loop, dominators);
+		}
+		BasicBlock *preheader = cfg::get_or_create_preheader(ir_function, loop);
+		Vec<Uptr<Instruction>> &insts = bb->get_inst();
+		Uptr<Instruction> allocation = mv(insts[index]);
+		insts.erase(insts.begin() + index);
+		Variable *array = *get_def(*allocation);
+
+		BasicBlock *allocating_block = preheader;
+		if (counted) {
+			Opt<int64_t> initial = find_initial_value(ir_function, loop, counted->induction_var);
+			Opt<int64_t> trip_count = initial ? find_trip_count(*counted, *initial) : Opt<int64_t> {};
+			if (!trip_count || *trip_count == 0) {
+				// the header sees the values the preheader leaves, since
+				// neither side of its test is written before it
+				Variable *entered = cfg::declare_variable(ir_function, array->get_name() + "_loop_entered", Type(A_type::int64, 0));
+				preheader->get_inst().push_back(mkuptr<InstructionAssignment>(
+					mkuptr<ItemRef<Variable>>(entered),
+					mkuptr<BinaryOperation>(
+						mkuptr<ItemRef<Variable>>(counted->induction_var),
+						counted->bound->clone(),
+						counted->op
+					)
+				));
+				allocating_block = cfg::insert_block_before(ir_function, loop.header, array->get_name() + "_allocate");
+				preheader->set_terminator(mkuptr<TerminatorBranchTwo>(
+					mkuptr<ItemRef<Variable>>(entered),
+					mkuptr<ItemRef<BasicBlock>>(allocating_block),
+					mkuptr<ItemRef<BasicBlock>>(loop.header)
+				));
+			}
+		}
+
+		Pair<int64_t, int64_t> words = *get_element_words(static_cast<InstructionInitializeArray &>(*allocation), array);
+		Vec<Uptr<Instruction>> &allocating_insts = allocating_block->get_inst();
+		allocating_insts.push_back(mv(allocation));
+		Variable *view = cfg::declare_variable(ir_function, array->get_name() + "_reset", Type(A_type::tuple, 0));
+		allocating_insts.push_back(mkuptr<InstructionAssignment>(mkuptr<ItemRef<Variable>>(view), mkuptr<ItemRef<Variable>>(array)));
+
+		BasicBlock *rest = cfg::split_block(ir_function, bb, index, bb->get_name() + "_after_reset");
+		reset_elements(ir_function, bb, view, words, rest);
+	}
+
+	// Hoists one allocation in the function out of the outermost loop it
+	// can leave. Returns whether it did.
+	bool hoist_one_allocation(IRFunction &ir_function) {
+		cfg::DominatorTree dominators = cfg::make_dominator_tree(ir_function);
+		Vec<cfg::Loop> loops = cfg::find_loops(ir_function, dominators);
+		if (loops.empty()) {
+			return false;
+		}
+		Set<Variable *> local_arrays = get_non_escaping_arrays(ir_function);
+		Liveness liveness = compute_liveness(ir_function);
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			Vec<Uptr<Instruction>> &insts = bb->get_inst();
+			for (int i = 0; i < insts.size(); ++i) {
+				if (!dynamic_cast<InstructionInitializeArray *>(insts[i].get()) || !local_arrays.count(*get_def(*insts[i]))) {
+					continue;
+				}
+				// inner loops come first
+				Opt<const cfg::Loop *> target;
+				for (const cfg::Loop &loop : loops) {
+					if (loop.contains(bb.get()) && can_hoist_allocation(loop, dominators, bb.get(), i, liveness)) {
+						target = &loop;
+					}
+				}
+				if (target) {
+					hoist_allocation(ir_function, **target, dominators, bb.get(), i);
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	bool hoist_allocations(Program &program) {
+		bool changed = false;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			while (hoist_one_allocation(*ir_function)) {
+				changed = true;
+			}
+		}
+		return changed;
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Allocation hoisting. An array or tuple of a few elements, allocated
+	// inside a loop with constant dimensions, is allocated once before the
+	// loop instead, if nothing but its own variable can ever refer to it
+	// (it is never stored, passed, returned or copied) and every iteration
+	// allocates it before using it. Where it used to be
+	// allocated, its elements are reset in place to the value `new` gives
+	// them. An allocation the loop might never reach is not hoisted, and
+	// one in a loop that might not run at all is only made once the loop's
+	// test lets it in. Returns whether the program was changed.
+	bool hoist_allocations(Program &program);
+}
@@ -0,0 +1,236 @@
+#include "analysis.h"
+#include "cfg.h"
+
+namespace IR::analysis {
+	Opt<Variable *> get_variable(const Uptr<Expr> &expr) {
+		if (ItemRef<Variable> *var_ref = dynamic_cast<ItemRef<Variable> *>(expr.get())) {
+			return var_ref->get_referent();
+		}
+		return {};
+	}
+
+	Opt<int64_t> get_number(const Uptr<Expr> &expr) {
+		if (NumberLiteral *num = dynamic_cast<NumberLiteral *>(expr.get())) {
+			return num->get_value();
+		}
+		return {};
+	}
+
+	Opt<Variable *> get_def(Instruction &inst) {
+		Opt<ItemRef<Variable> *> dest = inst.get_dest();
+		if (dest) {
+			return (*dest)->get_referent();
+		}
+		return {};
+	}
+
+	Vec<Variable *> get_uses(Instruction &inst) {
+		Vec<Variable *> result;
+		for (Uptr<Expr> *operand : inst.get_operands()) {
+			if (Opt<Variable *> var = get_variable(*operand)) {
+				result.push_back(*var);
+			}
+		}
+		if (Opt<ItemRef<Variable> *> array = inst.get_accessed_array()) {
+			if (Opt<Variable *> var = (*array)->get_referent()) {
+				result.push_back(*var);
+			}
+		}
+		return result;
+	}
+
+	Vec<Variable *> get_uses(Terminator &te) {
+		Vec<Variable *> result;
+		for (Uptr<Expr> *operand : te.get_operands()) {
+			if (Opt<Variable *> var = get_variable(*operand)) {
+				result.push_back(*var);
+			}
+		}
+		return result;
+	}
+
+	Opt<FunctionCall *> get_call(Instruction &inst) {
+		InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(&inst);
+		if (!assignment) {
+			return {};
+		}
+		if (FunctionCall *call = dynamic_cast<FunctionCall *>(assignment->get_source().get())) {
+			return call;
+		}
+		return {};
+	}
+
+	Opt<IRFunction *> get_called_function(Instruction &inst) {
+		Opt<FunctionCall *> call = get_call(inst);
+		if (!call) {
+			return {};
+		}
+		if (ItemRef<IRFunction> *callee = dynamic_cast<ItemRef<IRFunction> *>((*call)->get_callee().get())) {
+			return callee->get_referent();
+		}
+		return {};
+	}
+
+	int64_t get_function_size(IRFunction &ir_function) {
+		int64_t size = 0;
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				if (!dynamic_cast<InstructionDeclaration *>(inst.get())) {
+					size += 1;
+				}
+			}
+			size += 1;
+		}
+		return size;
+	}
+
+	void replace_variable(ItemRef<Variable> &ref, const Map<Variable *, Variable *> &replacements) {
+		auto it = replacements.find(*ref.get_referent());
+		if (it != replacements.end()) {
+			ref.bind(it->second);
+		}
+	}
+
+	bool uses_variable(Instruction &inst, Variable *var) {
+		Vec<Variable *> uses = get_uses(inst);
+		return std::find(uses.begin(), uses.end(), var) != uses.end();
+	}
+
+	void replace_variables(Instruction &inst, const Map<Variable *, Variable *> &replacements) {
+		if (Opt<ItemRef<Variable> *> dest = inst.get_dest()) {
+			replace_variable(**dest, replacements);
+		}
+		if (Opt<ItemRef<Variable> *> array = inst.get_accessed_array()) {
+			replace_variable(**array, replacements);
+		}
+		for (Uptr<Expr> *operand : inst.get_operands()) {
+			if (ItemRef<Variable> *ref = dynamic_cast<ItemRef<Variable> *>(operand->get())) {
+				replace_variable(*ref, replacements);
+			}
+		}
+	}
+
+	void replace_variables(Terminator &te, const Map<Variable *, Variable *> &replacements) {
+		for (Uptr<Expr> *operand : te.get_operands()) {
+			if (ItemRef<Variable> *ref = dynamic_cast<ItemRef<Variable> *>(operand->get())) {
+				replace_variable(*ref, replacements);
+			}
+		}
+	}
+
+	void transfer_reaching_definitions(Instruction &inst, DefinitionMap &definitions) {
+		if (Opt<Variable *> def = get_def(inst)) {
+			definitions[*def] = { &inst };
+		}
+	}
+
+	Map<BasicBlock *, DefinitionMap> compute_reaching_definitions(IRFunction &ir_function) {
+		Map<BasicBlock *, Vec<BasicBlock *>> predecessors = cfg::get_predecessors(ir_function);
+		Map<BasicBlock *, DefinitionMap> entry_definitions;
+		Map<BasicBlock *, DefinitionMap> exit_definitions;
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+				DefinitionMap definitions;
+				for (BasicBlock *pred : predecessors.at(block.get())) {
+					for (const auto &[var, insts] : exit_definitions[pred]) {
+						definitions[var] += insts;
+					}
+				}
+				entry_definitions[block.get()] = definitions;
+				for (const Uptr<Instruction> &inst : block->get_inst()) {
+					transfer_reaching_definitions(*inst, definitions);
+				}
+				DefinitionMap &old_definitions = exit_definitions[block.get()];
+				if (old_definitions != definitions) {
+					old_definitions = mv(definitions);
+					changed = true;
+				}
+			}
+		}
+		return entry_definitions;
+	}
+
+	Liveness compute_liveness(IRFunction &ir_function) {
+		// summarize each block by what it reads before writing (gen) and
+		// what it writes (kill)
+		Map<BasicBlock *, Set<Variable *>> gens;
+		Map<BasicBlock *, Set<Variable *>> kills;
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			Set<Variable *> &gen = gens[block.get()];
+			Set<Variable *> &kill = kills[block.get()];
+			for (Variable *var : get_uses(*block->get_terminator())) {
+				gen.insert(var);
+			}
+			Vec<Uptr<Instruction>> &insts = block->get_inst();
+			for (auto it = insts.rbegin(); it != insts.rend(); ++it) {
+				if (Opt<Variable *> def = get_def(**it)) {
+					gen.erase(*def);
+					kill.insert(*def);
+				}
+				for (Variable *var : get_uses(**it)) {
+					gen.insert(var);
+				}
+			}
+		}
+
+		Liveness result;
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			result.live_in[block.get()];
+			result.live_out[block.get()];
+		}
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			const Vec<Uptr<BasicBlock>> &blocks = ir_function.get_blocks();
+			for (auto it = blocks.rbegin(); it != blocks.rend(); ++it) {
+				BasicBlock *block = it->get();
+				Set<Variable *> live_out;
+				for (const auto &[succ, weight] : block->get_successors()) {
+					live_out += result.live_in.at(succ);
+				}
+				Set<Variable *> live_in = live_out;
+				live_in -= kills.at(block);
+				live_in += gens.at(block);
+				if (live_in != result.live_in.at(block)) {
+					result.live_in[block] = mv(live_in);
+					changed = true;
+				}
+				result.live_out[block] = mv(live_out);
+			}
+		}
+		return result;
+	}
+
+	Set<Variable *> get_non_escaping_arrays(IRFunction &ir_function) {
+		Set<Variable *> allocated;
+		Set<Variable *> escaping(
+			ir_function.get_parameter_vars().begin(),
+			ir_function.get_parameter_vars().end()
+		);
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			for (const Uptr<Instruction> &inst : block->get_inst()) {
+				if (Opt<Variable *> def = get_def(*inst)) {
+					if (dynamic_cast<InstructionInitializeArray *>(inst.get())) {
+						allocated.insert(*def);
+					} else {
+						// the variable might hold memory that came from elsewhere
+						escaping.insert(*def);
+					}
+				}
+				// any use as a value (stored, passed, returned, copied, ...)
+				// could let the memory be reached through something else
+				for (Uptr<Expr> *operand : inst->get_operands()) {
+					if (Opt<Variable *> var = get_variable(*operand)) {
+						escaping.insert(*var);
+					}
+				}
+			}
+			for (Variable *var : get_uses(*block->get_terminator())) {
+				escaping.insert(var);
+			}
+		}
+		return allocated -= escaping;
+	}
+}
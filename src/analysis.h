@@ -0,0 +1,59 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::analysis {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// returns the variable referred to by a value, if it is a variable
+	Opt<Variable *> get_variable(const Uptr<Expr> &expr);
+
+	// returns the value of a number literal
+	Opt<int64_t> get_number(const Uptr<Expr> &expr);
+
+	// returns the variable written by an instruction, if any
+	Opt<Variable *> get_def(Instruction &inst);
+
+	// returns the call an instruction makes, if any
+	Opt<FunctionCall *> get_call(Instruction &inst);
+
+	// returns the IR function an instruction directly calls, if any
+	Opt<IRFunction *> get_called_function(Instruction &inst);
+
+	// returns the number of instructions (other than declarations) and
+	// terminators a function is made of
+	int64_t get_function_size(IRFunction &ir_function);
+
+	// returns every variable read by an instruction or terminator
+	Vec<Variable *> get_uses(Instruction &inst);
+	Vec<Variable *> get_uses(Terminator &te);
+	// returns whether an instruction reads var
+	bool uses_variable(Instruction &inst, Variable *var);
+
+	// makes every reference to a variable in the map refer to the variable
+	// it maps to instead
+	void replace_variables(Instruction &inst, const Map<Variable *, Variable *> &replacements);
+	void replace_variables(Terminator &te, const Map<Variable *, Variable *> &replacements);
+
+	// maps each variable to the instructions whose definition of it may
+	// reach a point in the function. a variable missing from the map only
+	// holds the value it had on entry
+	using DefinitionMap = Map<Variable *, Set<Instruction *>>;
+	void transfer_reaching_definitions(Instruction &inst, DefinitionMap &definitions);
+	// returns the definitions that reach the start of each block
+	Map<BasicBlock *, DefinitionMap> compute_reaching_definitions(IRFunction &ir_function);
+
+	// the variables live at the start and at the end of each block
+	struct Liveness {
+		Map<BasicBlock *, Set<Variable *>> live_in;
+		Map<BasicBlock *, Set<Variable *>> live_out;
+	};
+	Liveness compute_liveness(IRFunction &ir_function);
+
+	// Returns the arrays and tuples that are only ever created by `new` in
+	// this function and only ever used to access their elements or length.
+	// Nothing outside the function (and no other variable) can refer to
+	// their memory.
+	Set<Variable *> get_non_escaping_arrays(IRFunction &ir_function);
+}
@@ -0,0 +1,281 @@
+#include "call_graph.h"
+#include "analysis.h"
+#include "cfg.h"
+#include <algorithm>
+#include <functional>
+
+namespace IR::call_graph {
+	using namespace IR::analysis;
+
+	const FunctionSummary no_effects = { false, false, false, false, false, false };
+	const FunctionSummary all_effects = { true, true, true, true, false, true };
+
+	CallGraph::CallGraph(Program &program) {
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			IRFunction *caller = ir_function.get();
+			this->callees[caller];
+			this->external_callees[caller];
+			Set<IRFunction *> &references = this->references[caller];
+			for (const Uptr<BasicBlock> &bb : ir_function->get_blocks()) {
+				for (const Uptr<Instruction> &inst : bb->get_inst()) {
+					Opt<FunctionCall *> call = get_call(*inst);
+					for (Uptr<Expr> *operand : inst->get_operands()) {
+						ItemRef<IRFunction> *ref = dynamic_cast<ItemRef<IRFunction> *>(operand->get());
+						if (!ref) {
+							continue;
+						}
+						references.insert(*ref->get_referent());
+						if (!call || operand != &(*call)->get_callee()) {
+							this->address_taken.insert(*ref->get_referent());
+						}
+					}
+					if (!call) {
+						continue;
+					}
+					Expr *callee = (*call)->get_callee().get();
+					if (ItemRef<IRFunction> *ref = dynamic_cast<ItemRef<IRFunction> *>(callee)) {
+						this->callees[caller].insert(*ref->get_referent());
+					} else if (ItemRef<ExternalFunction> *ref = dynamic_cast<ItemRef<ExternalFunction> *>(callee)) {
+						this->external_callees[caller].insert(ref->get_ref_name());
+					} else {
+						this->indirect_callers.insert(caller);
+					}
+				}
+				for (Uptr<Expr> *operand : bb->get_terminator()->get_operands()) {
+					if (ItemRef<IRFunction> *ref = dynamic_cast<ItemRef<IRFunction> *>(operand->get())) {
+						references.insert(*ref->get_referent());
+						this->address_taken.insert(*ref->get_referent());
+					}
+				}
+			}
+		}
+		for (IRFunction *caller : this->indirect_callers) {
+			this->callees[caller] += this->address_taken;
+		}
+	}
+
+	const Set<IRFunction *> &CallGraph::get_callees(IRFunction *ir_function) const {
+		return this->callees.at(ir_function);
+	}
+
+	const Set<std::string> &CallGraph::get_external_callees(IRFunction *ir_function) const {
+		return this->external_callees.at(ir_function);
+	}
+
+	bool CallGraph::has_indirect_calls(IRFunction *ir_function) const {
+		return this->indirect_callers.find(ir_function) != this->indirect_callers.end();
+	}
+
+	bool CallGraph::is_recursive(IRFunction *ir_function) const {
+		Set<IRFunction *> visited;
+		Vec<IRFunction *> stack(this->callees.at(ir_function).begin(), this->callees.at(ir_function).end());
+		while (!stack.empty()) {
+			IRFunction *callee = stack.back();
+			stack.pop_back();
+			if (callee == ir_function) {
+				return true;
+			}
+			if (!visited.insert(callee).second) {
+				continue;
+			}
+			stack += Vec<IRFunction *>(this->callees.at(callee).begin(), this->callees.at(callee).end());
+		}
+		return false;
+	}
+
+	Vec<IRFunction *> CallGraph::get_bottom_up_order(Program &program) const {
+		Vec<IRFunction *> result;
+		Set<IRFunction *> visited;
+		std::function<void(IRFunction *)> visit = [&](IRFunction *ir_function) {
+			if (!visited.insert(ir_function).second) {
+				return;
+			}
+			for (IRFunction *callee : this->callees.at(ir_function)) {
+				visit(callee);
+			}
+			result.push_back(ir_function);
+		};
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			visit(ir_function.get());
+		}
+		return result;
+	}
+
+	Set<IRFunction *> CallGraph::get_reachable_functions(Program &program) const {
+		Vec<IRFunction *> stack;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			if (ir_function->get_name() == "main") {
+				stack.push_back(ir_function.get());
+			}
+		}
+		Set<IRFunction *> result;
+		if (stack.empty()) {
+			for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+				result.insert(ir_function.get());
+			}
+			return result;
+		}
+		while (!stack.empty()) {
+			IRFunction *ir_function = stack.back();
+			stack.pop_back();
+			if (!result.insert(ir_function).second) {
+				continue;
+			}
+			for (IRFunction *callee : this->callees.at(ir_function)) {
+				stack.push_back(callee);
+			}
+			for (IRFunction *referenced : this->references.at(ir_function)) {
+				stack.push_back(referenced);
+			}
+		}
+		return result;
+	}
+
+	bool remove_unreachable_functions(Program &program) {
+		Set<IRFunction *> reachable = CallGraph(program).get_reachable_functions(program);
+		Vec<Uptr<IRFunction>> &ir_functions = program.get_ir_functions();
+		size_t num_functions = ir_functions.size();
+		ir_functions.erase(std::remove_if(ir_functions.begin(), ir_functions.end(), [&](const Uptr<IRFunction> &ir_function) {
+			return reachable.find(ir_function.get()) == reachable.end();
+		}), ir_functions.end());
+		return ir_functions.size() != num_functions;
+	}
+
+	FunctionSummary get_external_summary(const std::string &name) {
+		FunctionSummary summary = no_effects;
+		if (name == "print") {
+			// printing an array reads it
+			summary.reads_memory = true;
+			summary.does_io = true;
+		} else if (name == "input") {
+			summary.does_io = true;
+		} else if (name == "tensor-error" || name == "tuple-error") {
+			summary.does_io = true;
+			summary.may_exit = true;
+			summary.never_returns = true;
+		} else if (name != "allocate") {
+			summary = all_effects;
+		}
+		return summary;
+	}
+
+	void merge_summary(FunctionSummary &dest, const FunctionSummary &other) {
+		dest.reads_memory |= other.reads_memory;
+		dest.writes_memory |= other.writes_memory;
+		dest.does_io |= other.does_io;
+		dest.may_exit |= other.may_exit;
+		dest.may_not_terminate |= other.may_not_terminate;
+	}
+
+	// what the function's own instructions do, not counting its callees
+	FunctionSummary summarize_instructions(IRFunction &ir_function) {
+		FunctionSummary summary = no_effects;
+		Set<Variable *> local_arrays = get_non_escaping_arrays(ir_function);
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				Opt<ItemRef<Variable> *> array = inst->get_accessed_array();
+				if (!array || local_arrays.find(*(*array)->get_referent()) != local_arrays.end()) {
+					continue;
+				}
+				if (dynamic_cast<InstructionStore *>(inst.get())) {
+					summary.writes_memory = true;
+				} else {
+					summary.reads_memory = true;
+				}
+			}
+		}
+		summary.may_not_terminate = !cfg::get_retreating_edges(ir_function).empty();
+		return summary;
+	}
+
+	// Returns whether every path from the entry to a return goes through
+	// a call that never returns
+	bool never_returns(IRFunction &ir_function, const SummaryMap &summaries) {
+		Set<BasicBlock *> visited;
+		Vec<BasicBlock *> stack = { ir_function.get_blocks()[0].get() };
+		while (!stack.empty()) {
+			BasicBlock *bb = stack.back();
+			stack.pop_back();
+			if (!visited.insert(bb).second) {
+				continue;
+			}
+			bool stops = false;
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				Opt<FunctionCall *> call = get_call(*inst);
+				if (call && get_call_summary(**call, summaries).never_returns) {
+					stops = true;
+					break;
+				}
+			}
+			if (stops) {
+				continue;
+			}
+			if (bb->get_successors().empty()) {
+				return false;
+			}
+			for (const auto &[succ, weight] : bb->get_successors()) {
+				stack.push_back(succ);
+			}
+		}
+		return true;
+	}
+
+	SummaryMap summarize_functions(Program &program, const CallGraph &call_graph) {
+		Map<IRFunction *, FunctionSummary> own_summaries;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			FunctionSummary summary = summarize_instructions(*ir_function);
+			summary.may_not_terminate |= call_graph.is_recursive(ir_function.get());
+			for (const std::string &name : call_graph.get_external_callees(ir_function.get())) {
+				merge_summary(summary, get_external_summary(name));
+			}
+			own_summaries.emplace(ir_function.get(), summary);
+		}
+
+		// add the effects of the callees until nothing changes. the
+		// callees come first, so this usually takes one pass
+		SummaryMap summaries = own_summaries;
+		Vec<IRFunction *> order = call_graph.get_bottom_up_order(program);
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (IRFunction *ir_function : order) {
+				FunctionSummary summary = summaries.at(ir_function);
+				for (IRFunction *callee : call_graph.get_callees(ir_function)) {
+					merge_summary(summary, summaries.at(callee));
+				}
+				summary.never_returns = never_returns(*ir_function, summaries);
+				FunctionSummary &old_summary = summaries.at(ir_function);
+				if (summary.reads_memory != old_summary.reads_memory
+					|| summary.writes_memory != old_summary.writes_memory
+					|| summary.does_io != old_summary.does_io
+					|| summary.may_exit != old_summary.may_exit
+					|| summary.never_returns != old_summary.never_returns
+					|| summary.may_not_terminate != old_summary.may_not_terminate)
+				{
+					old_summary = summary;
+					changed = true;
+				}
+			}
+		}
+
+		FunctionSummary indirect_summary = no_effects;
+		for (IRFunction *ir_function : call_graph.get_address_taken()) {
+			merge_summary(indirect_summary, summaries.at(ir_function));
+		}
+		summaries.emplace(nullptr, indirect_summary);
+		return summaries;
+	}
+
+	FunctionSummary get_call_summary(FunctionCall &call, const SummaryMap &summaries) {
+		Expr *callee = call.get_callee().get();
+		if (ItemRef<ExternalFunction> *ref = dynamic_cast<ItemRef<ExternalFunction> *>(callee)) {
+			return get_external_summary(ref->get_ref_name());
+		}
+		IRFunction *ir_function = nullptr;
+		if (ItemRef<IRFunction> *ref = dynamic_cast<ItemRef<IRFunction> *>(callee)) {
+			ir_function = *ref->get_referent();
+		}
+		auto it = summaries.find(ir_function);
+		return it != summaries.end() ? it->second : all_effects;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::call_graph {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Which functions each function may call or refer to. A call through a
+	// variable (holding `code`) may call any function whose address is
+	// taken anywhere in the program.
+	class CallGraph {
+		Map<IRFunction *, Set<IRFunction *>> callees;
+		Map<IRFunction *, Set<std::string>> external_callees;
+		Map<IRFunction *, Set<IRFunction *>> references;
+		Set<IRFunction *> indirect_callers;
+		Set<IRFunction *> address_taken;
+
+		public:
+
+		explicit CallGraph(Program &program);
+
+		// the IR functions a function may call, directly or not
+		const Set<IRFunction *> &get_callees(IRFunction *ir_function) const;
+		// the names of the runtime functions a function calls
+		const Set<std::string> &get_external_callees(IRFunction *ir_function) const;
+		bool has_indirect_calls(IRFunction *ir_function) const;
+		// the functions whose address is used as a value
+		const Set<IRFunction *> &get_address_taken() const { return this->address_taken; }
+
+		// whether the function can end up calling itself
+		bool is_recursive(IRFunction *ir_function) const;
+
+		// orders the functions so that callees come before their callers,
+		// except within recursive cycles
+		Vec<IRFunction *> get_bottom_up_order(Program &program) const;
+
+		// returns the functions @main can end up calling or referring to,
+		// or every function if there is no @main
+		Set<IRFunction *> get_reachable_functions(Program &program) const;
+	};
+
+	// Removes the functions that can never be called from @main. Returns
+	// whether any was removed.
+	bool remove_unreachable_functions(Program &program);
+
+	// What a function (including everything it calls) may do besides
+	// computing its return value. Memory only counts if the caller could
+	// see it, so arrays the function allocates for itself don't.
+	struct FunctionSummary {
+		bool reads_memory;
+		bool writes_memory;
+		// calls print or input
+		bool does_io;
+		// may end the program through tensor-error or tuple-error
+		bool may_exit;
+		// always ends the program instead of returning
+		bool never_returns;
+		// has a loop or recursion, so may run forever
+		bool may_not_terminate;
+
+		// a call to a pure function can be removed, moved or reused freely
+		bool is_pure() const {
+			return !this->reads_memory && !this->has_side_effects();
+		}
+		// a call without side effects can be removed if its result is unused
+		bool has_side_effects() const {
+			return this->writes_memory || this->does_io || this->may_exit || this->may_not_terminate;
+		}
+	};
+
+	// maps each IR function to its summary. the summary under nullptr
+	// covers every function that can be called through a variable
+	using SummaryMap = Map<IRFunction *, FunctionSummary>;
+	SummaryMap summarize_functions(Program &program, const CallGraph &call_graph);
+
+	// returns what a call may do, assuming the worst for unknown callees
+	FunctionSummary get_call_summary(FunctionCall &call, const SummaryMap &summaries);
+}
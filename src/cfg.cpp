@@ -0,0 +1,487 @@
+#include "cfg.h"
+#include <algorithm>
+
+namespace IR::cfg {
+	Map<BasicBlock *, Vec<BasicBlock *>> get_predecessors(IRFunction &ir_function) {
+		Map<BasicBlock *, Vec<BasicBlock *>> result;
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			result[block.get()];
+		}
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			for (const auto &[succ, weight] : block->get_successors()) {
+				result[succ].push_back(block.get());
+			}
+		}
+		return result;
+	}
+
+	Set<BasicBlock *> get_reachable_blocks(IRFunction &ir_function) {
+		Set<BasicBlock *> visited;
+		Vec<BasicBlock *> stack = { ir_function.get_blocks()[0].get() };
+		while (!stack.empty()) {
+			BasicBlock *block = stack.back();
+			stack.pop_back();
+			if (!visited.insert(block).second) {
+				continue;
+			}
+			for (const auto &[succ, weight] : block->get_successors()) {
+				stack.push_back(succ);
+			}
+		}
+		return visited;
+	}
+
+	Vec<Pair<BasicBlock *, BasicBlock *>> get_retreating_edges(IRFunction &ir_function) {
+		Vec<Pair<BasicBlock *, BasicBlock *>> result;
+		Set<BasicBlock *> visited;
+		Set<BasicBlock *> on_stack;
+		// each stack frame is a block and the index of the next successor to visit
+		Vec<Pair<BasicBlock *, int>> stack;
+		BasicBlock *entry_block = ir_function.get_blocks()[0].get();
+		visited.insert(entry_block);
+		on_stack.insert(entry_block);
+		stack.emplace_back(entry_block, 0);
+		while (!stack.empty()) {
+			auto &[block, succ_index] = stack.back();
+			if (succ_index >= block->get_successors().size()) {
+				on_stack.erase(block);
+				stack.pop_back();
+				continue;
+			}
+			BasicBlock *succ = block->get_successors()[succ_index].first;
+			++succ_index;
+			if (on_stack.find(succ) != on_stack.end()) {
+				result.emplace_back(block, succ);
+			} else if (visited.insert(succ).second) {
+				on_stack.insert(succ);
+				stack.emplace_back(succ, 0);
+			}
+		}
+		return result;
+	}
+
+	DominatorTree::DominatorTree(
+		BasicBlock *root,
+		const Map<BasicBlock *, Vec<BasicBlock *>> &successors,
+		const Map<BasicBlock *, Vec<BasicBlock *>> &predecessors
+	) :
+		root { root },
+		predecessors { predecessors }
+	{
+		// number the nodes in reverse postorder
+		Vec<BasicBlock *> postorder;
+		Set<BasicBlock *> visited = { root };
+		Vec<Pair<BasicBlock *, int>> stack = { { root, 0 } };
+		while (!stack.empty()) {
+			auto &[node, succ_index] = stack.back();
+			const Vec<BasicBlock *> &succs = successors.at(node);
+			if (succ_index >= succs.size()) {
+				postorder.push_back(node);
+				stack.pop_back();
+				continue;
+			}
+			BasicBlock *succ = succs[succ_index];
+			++succ_index;
+			if (visited.insert(succ).second) {
+				stack.emplace_back(succ, 0);
+			}
+		}
+		Map<BasicBlock *, int> rpo_numbers;
+		for (int i = 0; i < postorder.size(); ++i) {
+			rpo_numbers[postorder[i]] = postorder.size() - 1 - i;
+		}
+
+		// find the immediate dominators with the iterative algorithm by
+		// Cooper, Harvey, and Kennedy
+		Map<BasicBlock *, BasicBlock *> &idoms = this->idoms;
+		idoms[root] = root;
+		auto intersect = [&](BasicBlock *a, BasicBlock *b) {
+			while (a != b) {
+				while (rpo_numbers.at(a) > rpo_numbers.at(b)) {
+					a = idoms.at(a);
+				}
+				while (rpo_numbers.at(b) > rpo_numbers.at(a)) {
+					b = idoms.at(b);
+				}
+			}
+			return a;
+		};
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (auto it = postorder.rbegin(); it != postorder.rend(); ++it) {
+				BasicBlock *node = *it;
+				if (node == root) {
+					continue;
+				}
+				Opt<BasicBlock *> new_idom;
+				for (BasicBlock *pred : predecessors.at(node)) {
+					if (idoms.find(pred) == idoms.end()) {
+						continue;
+					}
+					new_idom = new_idom ? intersect(pred, *new_idom) : pred;
+				}
+				auto idom_it = idoms.find(node);
+				if (idom_it == idoms.end() || idom_it->second != *new_idom) {
+					idoms[node] = *new_idom;
+					changed = true;
+				}
+			}
+		}
+		idoms.erase(root);
+
+		// build the tree and number it so dominance queries are cheap
+		for (BasicBlock *node : postorder) {
+			this->children[node];
+		}
+		for (const auto &[node, idom] : idoms) {
+			this->children[idom].push_back(node);
+		}
+		int counter = 0;
+		Vec<Pair<BasicBlock *, int>> tree_stack = { { root, 0 } };
+		this->intervals[root].first = counter++;
+		while (!tree_stack.empty()) {
+			auto &[node, child_index] = tree_stack.back();
+			const Vec<BasicBlock *> &node_children = this->children.at(node);
+			if (child_index >= node_children.size()) {
+				this->intervals[node].second = counter++;
+				tree_stack.pop_back();
+				continue;
+			}
+			BasicBlock *child = node_children[child_index];
+			++child_index;
+			this->intervals[child].first = counter++;
+			tree_stack.emplace_back(child, 0);
+		}
+	}
+	Opt<BasicBlock *> DominatorTree::get_idom(BasicBlock *bb) const {
+		auto it = this->idoms.find(bb);
+		if (it != this->idoms.end()) {
+			return it->second;
+		}
+		return {};
+	}
+	bool DominatorTree::dominates(BasicBlock *a, BasicBlock *b) const {
+		auto a_it = this->intervals.find(a);
+		auto b_it = this->intervals.find(b);
+		if (a_it == this->intervals.end() || b_it == this->intervals.end()) {
+			return false;
+		}
+		return a_it->second.first <= b_it->second.first
+			&& b_it->second.second <= a_it->second.second;
+	}
+	Map<BasicBlock *, Set<BasicBlock *>> DominatorTree::get_frontiers() const {
+		Map<BasicBlock *, Set<BasicBlock *>> result;
+		for (const auto &[node, interval] : this->intervals) {
+			result[node];
+		}
+		for (const auto &[node, idom] : this->idoms) {
+			for (BasicBlock *pred : this->predecessors.at(node)) {
+				if (!this->contains(pred)) {
+					continue;
+				}
+				for (BasicBlock *runner = pred; runner != idom; runner = this->idoms.at(runner)) {
+					result[runner].insert(node);
+				}
+			}
+		}
+		return result;
+	}
+	DominatorTree make_dominator_tree(IRFunction &ir_function) {
+		Map<BasicBlock *, Vec<BasicBlock *>> successors;
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			Vec<BasicBlock *> &succs = successors[block.get()];
+			for (const auto &[succ, weight] : block->get_successors()) {
+				succs.push_back(succ);
+			}
+		}
+		return DominatorTree(
+			ir_function.get_blocks()[0].get(),
+			successors,
+			get_predecessors(ir_function)
+		);
+	}
+	DominatorTree make_post_dominator_tree(IRFunction &ir_function) {
+		// flip every edge, and connect the virtual exit to the blocks that return
+		Map<BasicBlock *, Vec<BasicBlock *>> reverse_successors = { { nullptr, {} } };
+		Map<BasicBlock *, Vec<BasicBlock *>> reverse_predecessors = { { nullptr, {} } };
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			reverse_successors[block.get()];
+			reverse_predecessors[block.get()];
+		}
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			if (block->get_successors().empty()) {
+				reverse_successors[nullptr].push_back(block.get());
+				reverse_predecessors[block.get()].push_back(nullptr);
+			}
+			for (const auto &[succ, weight] : block->get_successors()) {
+				reverse_successors[succ].push_back(block.get());
+				reverse_predecessors[block.get()].push_back(succ);
+			}
+		}
+		return DominatorTree(nullptr, reverse_successors, reverse_predecessors);
+	}
+
+	Set<BasicBlock *> Loop::get_exit_blocks() const {
+		Set<BasicBlock *> result;
+		for (BasicBlock *block : this->blocks) {
+			for (const auto &[succ, weight] : block->get_successors()) {
+				if (!this->contains(succ)) {
+					result.insert(succ);
+				}
+			}
+		}
+		return result;
+	}
+	Set<BasicBlock *> Loop::get_exiting_blocks() const {
+		Set<BasicBlock *> result;
+		for (BasicBlock *block : this->blocks) {
+			for (const auto &[succ, weight] : block->get_successors()) {
+				if (!this->contains(succ)) {
+					result.insert(block);
+				}
+			}
+		}
+		return result;
+	}
+
+	int64_t Loop::get_size() const {
+		int64_t size = 0;
+		for (BasicBlock *block : this->blocks) {
+			for (const Uptr<Instruction> &inst : block->get_inst()) {
+				if (!dynamic_cast<InstructionDeclaration *>(inst.get())) {
+					size++;
+				}
+			}
+			size++;
+		}
+		return size;
+	}
+
+	Vec<Loop> find_loops(IRFunction &ir_function, const DominatorTree &dominators) {
+		Map<BasicBlock *, Vec<BasicBlock *>> predecessors = get_predecessors(ir_function);
+		Map<BasicBlock *, Loop> loops_by_header;
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			for (const auto &[succ, weight] : block->get_successors()) {
+				if (!dominators.dominates(succ, block.get())) {
+					continue;
+				}
+				// block -> succ is a back edge
+				Loop &loop = loops_by_header[succ];
+				loop.header = succ;
+				loop.blocks.insert(succ);
+				loop.latches.push_back(block.get());
+				Vec<BasicBlock *> stack = { block.get() };
+				while (!stack.empty()) {
+					BasicBlock *loop_block = stack.back();
+					stack.pop_back();
+					if (!loop.blocks.insert(loop_block).second) {
+						continue;
+					}
+					stack += predecessors.at(loop_block);
+				}
+			}
+		}
+		Vec<Loop> result;
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			auto loop_it = loops_by_header.find(block.get());
+			if (loop_it != loops_by_header.end()) {
+				result.push_back(mv(loop_it->second));
+			}
+		}
+		// a loop nested in another has fewer blocks
+		std::stable_sort(result.begin(), result.end(), [](const Loop &a, const Loop &b) {
+			return a.blocks.size() < b.blocks.size();
+		});
+		return result;
+	}
+
+	std::string get_unused_block_name(IRFunction &ir_function, const std::string &name_hint) {
+		Set<std::string> names;
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			names.insert(block->get_name());
+		}
+		std::string name = name_hint;
+		for (int counter = 0; names.find(name) != names.end(); ++counter) {
+			name = name_hint + std::to_string(counter);
+		}
+		return name;
+	}
+
+	Variable *declare_variable(IRFunction &ir_function, const std::string &name_hint, const Type &type) {
+		Set<std::string> names;
+		for (Variable *var : ir_function.get_parameter_vars()) {
+			names.insert(var->get_name());
+		}
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			for (const Uptr<Instruction> &inst : block->get_inst()) {
+				if (InstructionDeclaration *decl = dynamic_cast<InstructionDeclaration *>(inst.get())) {
+					names.insert((*decl->get_referent())->get_name());
+				}
+			}
+		}
+		std::string name = name_hint;
+		for (int counter = 0; names.find(name) != names.end(); ++counter) {
+			name = name_hint + std::to_string(counter);
+		}
+		Uptr<Variable> var = mkuptr<Variable>(name, type);
+		Variable *result = var.get();
+		Vec<Uptr<Instruction>> &entry_insts = ir_function.get_blocks()[0]->get_inst();
+		entry_insts.insert(entry_insts.begin(), mkuptr<InstructionDeclaration>(mv(var)));
+		return result;
+	}
+
+	BasicBlock *insert_block_before(IRFunction &ir_function, BasicBlock *target, const std::string &name_hint) {
+		Uptr<BasicBlock> block = mkuptr<BasicBlock>(
+			get_unused_block_name(ir_function, name_hint),
+			Vec<Uptr<Instruction>> {},
+			mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(target))
+		);
+		block->set_successors(block->get_terminator()->get_successor());
+		BasicBlock *result = block.get();
+		Vec<Uptr<BasicBlock>> &blocks = ir_function.get_blocks();
+		auto position = std::find_if(blocks.begin(), blocks.end(), [&](const Uptr<BasicBlock> &b) {
+			return b.get() == target;
+		});
+		blocks.insert(position, mv(block));
+		return result;
+	}
+
+	BasicBlock *split_block(IRFunction &ir_function, BasicBlock *bb, int index, const std::string &name_hint) {
+		Vec<Uptr<Instruction>> &insts = bb->get_inst();
+		Vec<Uptr<Instruction>> rest;
+		for (auto it = insts.begin() + index; it != insts.end(); ++it) {
+			rest.push_back(mv(*it));
+		}
+		insts.erase(insts.begin() + index, insts.end());
+		Uptr<BasicBlock> block = mkuptr<BasicBlock>(
+			get_unused_block_name(ir_function, name_hint),
+			mv(rest),
+			mv(bb->get_terminator())
+		);
+		block->set_successors(block->get_terminator()->get_successor());
+		BasicBlock *result = block.get();
+		Vec<Uptr<BasicBlock>> &blocks = ir_function.get_blocks();
+		auto position = std::find_if(blocks.begin(), blocks.end(), [&](const Uptr<BasicBlock> &b) {
+			return b.get() == bb;
+		});
+		blocks.insert(position + 1, mv(block));
+		bb->set_terminator(mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(result)));
+		return result;
+	}
+
+	void redirect_edges(BasicBlock &from, BasicBlock *old_target, BasicBlock *new_target) {
+		for (ItemRef<BasicBlock> *target : from.get_terminator()->get_targets()) {
+			if (target->get_referent() == old_target) {
+				target->bind(new_target);
+			}
+		}
+		from.set_successors(from.get_terminator()->get_successor());
+	}
+
+	Map<BasicBlock *, BasicBlock *> clone_loop(IRFunction &ir_function, const Loop &loop, const std::string &name_suffix) {
+		Vec<Uptr<BasicBlock>> &blocks = ir_function.get_blocks();
+		Vec<BasicBlock *> loop_blocks;
+		int position = 0;
+		for (int i = 0; i < blocks.size(); ++i) {
+			if (loop.contains(blocks[i].get())) {
+				loop_blocks.push_back(blocks[i].get());
+				position = i + 1;
+			}
+		}
+		Map<BasicBlock *, BasicBlock *> block_map;
+		for (BasicBlock *block : loop_blocks) {
+			Vec<Uptr<Instruction>> insts;
+			for (const Uptr<Instruction> &inst : block->get_inst()) {
+				if (!dynamic_cast<InstructionDeclaration *>(inst.get())) {
+					insts.push_back(inst->clone());
+				}
+			}
+			Uptr<BasicBlock> copy = mkuptr<BasicBlock>(
+				get_unused_block_name(ir_function, block->get_name() + name_suffix),
+				mv(insts),
+				block->get_terminator()->clone()
+			);
+			block_map.emplace(block, copy.get());
+			blocks.insert(blocks.begin() + position, mv(copy));
+			++position;
+		}
+		for (const auto &[block, copy] : block_map) {
+			for (ItemRef<BasicBlock> *target : copy->get_terminator()->get_targets()) {
+				auto it = block_map.find(*target->get_referent());
+				if (it != block_map.end()) {
+					target->bind(it->second);
+				}
+			}
+			copy->set_successors(copy->get_terminator()->get_successor());
+		}
+		return block_map;
+	}
+
+	Map<BasicBlock *, BasicBlock *> version_loop(
+		IRFunction &ir_function,
+		const Loop &loop,
+		Uptr<Expr> condition,
+		const std::string &name_suffix
+	) {
+		BasicBlock *preheader = get_or_create_preheader(ir_function, loop);
+		Map<BasicBlock *, BasicBlock *> block_map = clone_loop(ir_function, loop, name_suffix);
+		preheader->set_terminator(mkuptr<TerminatorBranchTwo>(
+			mv(condition),
+			mkuptr<ItemRef<BasicBlock>>(loop.header),
+			mkuptr<ItemRef<BasicBlock>>(block_map.at(loop.header))
+		));
+		return block_map;
+	}
+
+	BasicBlock *get_or_create_preheader(IRFunction &ir_function, const Loop &loop) {
+		bool is_entry = ir_function.get_blocks()[0].get() == loop.header;
+		Map<BasicBlock *, Vec<BasicBlock *>> predecessors = get_predecessors(ir_function);
+		Vec<BasicBlock *> outside_preds;
+		for (BasicBlock *pred : predecessors.at(loop.header)) {
+			if (!loop.contains(pred)) {
+				outside_preds.push_back(pred);
+			}
+		}
+		if (!is_entry && outside_preds.size() == 1 && outside_preds[0]->get_successors().size() == 1) {
+			return outside_preds[0];
+		}
+		BasicBlock *preheader = insert_block_before(ir_function, loop.header, loop.header->get_name() + "_preheader");
+		for (BasicBlock *pred : outside_preds) {
+			redirect_edges(*pred, loop.header, preheader);
+		}
+		return preheader;
+	}
+
+	bool remove_unreachable_blocks(IRFunction &ir_function) {
+		Set<BasicBlock *> reachable = get_reachable_blocks(ir_function);
+		Vec<Uptr<BasicBlock>> &blocks = ir_function.get_blocks();
+		if (reachable.size() == blocks.size()) {
+			return false;
+		}
+
+		Vec<Uptr<BasicBlock>> kept_blocks;
+		Vec<Uptr<Instruction>> declarations;
+		for (Uptr<BasicBlock> &block : blocks) {
+			if (reachable.find(block.get()) != reachable.end()) {
+				kept_blocks.push_back(mv(block));
+				continue;
+			}
+			for (Uptr<Instruction> &inst : block->get_inst()) {
+				if (dynamic_cast<InstructionDeclaration *>(inst.get())) {
+					declarations.push_back(mv(inst));
+				}
+			}
+		}
+
+		// the entry block is always reachable, so it is still the first block
+		Vec<Uptr<Instruction>> &entry_inst = kept_blocks[0]->get_inst();
+		entry_inst.insert(
+			entry_inst.begin(),
+			std::make_move_iterator(declarations.begin()),
+			std::make_move_iterator(declarations.end())
+		);
+		blocks = mv(kept_blocks);
+		return true;
+	}
+}
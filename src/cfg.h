@@ -0,0 +1,122 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::cfg {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// returns the blocks that can branch to each block of the function. a
+	// block appears once per edge, so a predecessor with two edges to the
+	// same block appears twice
+	Map<BasicBlock *, Vec<BasicBlock *>> get_predecessors(IRFunction &ir_function);
+
+	// returns every block that can be reached from the entry block
+	Set<BasicBlock *> get_reachable_blocks(IRFunction &ir_function);
+
+	// returns the edges which go back to a block that is still being
+	// visited in a depth-first search from the entry block. every cycle in
+	// the CFG contains at least one of them
+	Vec<Pair<BasicBlock *, BasicBlock *>> get_retreating_edges(IRFunction &ir_function);
+
+	// The immediate dominator relationships of a graph of blocks. For
+	// post-dominators, the root is a virtual exit block represented by
+	// nullptr that every returning block flows into. Nodes that cannot be
+	// reached from the root are not part of the tree.
+	class DominatorTree {
+		BasicBlock *root;
+		Map<BasicBlock *, BasicBlock *> idoms;
+		Map<BasicBlock *, Vec<BasicBlock *>> children;
+		Map<BasicBlock *, Vec<BasicBlock *>> predecessors;
+		// the preorder and postorder numbers of each node in the tree
+		Map<BasicBlock *, Pair<int, int>> intervals;
+
+		public:
+
+		DominatorTree(
+			BasicBlock *root,
+			const Map<BasicBlock *, Vec<BasicBlock *>> &successors,
+			const Map<BasicBlock *, Vec<BasicBlock *>> &predecessors
+		);
+		BasicBlock *get_root() const { return this->root; }
+		bool contains(BasicBlock *bb) const { return this->intervals.find(bb) != this->intervals.end(); }
+		Opt<BasicBlock *> get_idom(BasicBlock *bb) const;
+		const Vec<BasicBlock *> &get_children(BasicBlock *bb) const { return this->children.at(bb); }
+		bool dominates(BasicBlock *a, BasicBlock *b) const;
+		// returns the dominance frontier of every node in the tree
+		Map<BasicBlock *, Set<BasicBlock *>> get_frontiers() const;
+	};
+	DominatorTree make_dominator_tree(IRFunction &ir_function);
+	DominatorTree make_post_dominator_tree(IRFunction &ir_function);
+
+	// A natural loop: the blocks that can reach one of the latches (blocks
+	// branching back to the header) without going through the header,
+	// plus the header itself, which dominates all of them.
+	struct Loop {
+		BasicBlock *header;
+		Set<BasicBlock *> blocks;
+		Vec<BasicBlock *> latches;
+
+		bool contains(BasicBlock *bb) const { return this->blocks.find(bb) != this->blocks.end(); }
+		// the blocks outside the loop that the loop can branch to
+		Set<BasicBlock *> get_exit_blocks() const;
+		// the blocks inside the loop that can branch outside it
+		Set<BasicBlock *> get_exiting_blocks() const;
+		// the number of instructions and terminators in the loop
+		int64_t get_size() const;
+	};
+
+	// Returns the natural loops of the function, with loops sharing a
+	// header merged into one. Inner loops come before the loops that
+	// contain them.
+	Vec<Loop> find_loops(IRFunction &ir_function, const DominatorTree &dominators);
+
+	// returns a name for a new block which no block in the function has
+	std::string get_unused_block_name(IRFunction &ir_function, const std::string &name_hint);
+
+	// declares a new variable at the start of the entry block, with a name
+	// no other variable of the function has
+	Variable *declare_variable(IRFunction &ir_function, const std::string &name_hint, const Type &type);
+
+	// Creates a block that only branches to target and places it right
+	// before target in the function. If target was the entry block, the
+	// new block becomes the entry block.
+	BasicBlock *insert_block_before(IRFunction &ir_function, BasicBlock *target, const std::string &name_hint);
+
+	// Moves the instructions of the block from index on, together with its
+	// terminator, into a new block placed right after it, which the block
+	// then branches to. Returns the new block.
+	BasicBlock *split_block(IRFunction &ir_function, BasicBlock *bb, int index, const std::string &name_hint);
+
+	// makes every edge from `from` to old_target go to new_target instead
+	void redirect_edges(BasicBlock &from, BasicBlock *old_target, BasicBlock *new_target);
+
+	// Copies the blocks of a loop into the function, right after the last
+	// of them. Edges between blocks of the loop go between their copies,
+	// and edges leaving the loop still leave it. The copies share the
+	// loop's variables, so declarations aren't copied. Returns the copy of
+	// each block.
+	Map<BasicBlock *, BasicBlock *> clone_loop(IRFunction &ir_function, const Loop &loop, const std::string &name_suffix);
+
+	// Versions a loop on a condition: the loop is copied, and its
+	// preheader branches to the original loop if the condition holds and
+	// to the copy otherwise. Returns the copy of each block.
+	Map<BasicBlock *, BasicBlock *> version_loop(
+		IRFunction &ir_function,
+		const Loop &loop,
+		Uptr<Expr> condition,
+		const std::string &name_suffix
+	);
+
+	// Returns the single block outside the loop that branches to its
+	// header and nowhere else, creating one if necessary. Creating a
+	// preheader changes the CFG, so previously computed dominator trees
+	// and loops (other than this one) become stale.
+	BasicBlock *get_or_create_preheader(IRFunction &ir_function, const Loop &loop);
+
+	// Removes all blocks which cannot be reached from the entry block.
+	// Variable declarations in the removed blocks are moved to the entry
+	// block since the declared variables may still be used elsewhere.
+	// Returns whether any block was removed.
+	bool remove_unreachable_blocks(IRFunction &ir_function);
+}
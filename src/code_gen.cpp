@@ -1,10 +1,84 @@
 #include "code_gen.h"
+#include "analysis.h"
+#include "outliner.h"
 
 namespace IR::code_gen {
     using namespace std_alias;
     using namespace IR::program;
     using namespace IR::tracer;
 
+    // A branch whose true target comes right after it would have to invert
+    // its condition to jump to the false target. If the branch is the only
+    // thing reading the condition, and the condition is computed by a
+    // comparison in the same block, the comparison is negated and the
+    // targets swapped instead.
+    void invert_fall_through_branch(BasicBlock &bb, const Set<Variable *> &live_out) {
+        TerminatorBranchTwo *branch = dynamic_cast<TerminatorBranchTwo *>(bb.get_terminator().get());
+        Opt<Variable *> condition = analysis::get_variable(*branch->get_operands()[0]);
+        if (!condition || live_out.count(*condition)) {
+            return;
+        }
+        Set<Variable *> defined_after;
+        Vec<Uptr<Instruction>> &insts = bb.get_inst();
+        for (auto it = insts.rbegin(); it != insts.rend(); ++it) {
+            Vec<Variable *> uses = analysis::get_uses(**it);
+            Opt<Variable *> def = analysis::get_def(**it);
+            if (!def || *def != *condition) {
+                if (std::find(uses.begin(), uses.end(), *condition) != uses.end()) {
+                    return;
+                }
+                if (def) {
+                    defined_after.insert(*def);
+                }
+                continue;
+            }
+            InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(it->get());
+            BinaryOperation *bin_op = assignment ? dynamic_cast<BinaryOperation *>(assignment->get_source().get()) : nullptr;
+            if (!bin_op) {
+                return;
+            }
+            Opt<Operator> negated = negate_operator(bin_op->get_operator());
+            for (Uptr<Expr> *operand : { &bin_op->get_lhs(), &bin_op->get_rhs() }) {
+                Opt<Variable *> var = analysis::get_variable(*operand);
+                if (var && defined_after.count(*var)) {
+                    return;
+                }
+            }
+            if (negated) {
+                assignment->get_source() = mkuptr<BinaryOperation>(bin_op->get_lhs()->clone(), bin_op->get_rhs()->clone(), *negated);
+            } else if (is_comparison(bin_op->get_operator())) {
+                // equality has no negation, but its result is 0 or 1
+                insts.insert(it.base(), mkuptr<InstructionAssignment>(
+                    mkuptr<ItemRef<Variable>>(*condition),
+                    mkuptr<BinaryOperation>(mkuptr<ItemRef<Variable>>(*condition), mkuptr<NumberLiteral>(0), Operator::eq)
+                ));
+            } else {
+                return;
+            }
+            bb.set_terminator(mkuptr<TerminatorBranchTwo>(
+                (*branch->get_operands()[0])->clone(),
+                mkuptr<ItemRef<BasicBlock>>(branch->get_branch_false()),
+                mkuptr<ItemRef<BasicBlock>>(branch->get_branch_true())
+            ));
+            return;
+        }
+    }
+
+    void invert_fall_through_branches(IRFunction &ir_function, const Vec<Trace> &traces) {
+        analysis::Liveness liveness = analysis::compute_liveness(ir_function);
+        for (const Trace &trace : traces) {
+            for (int i = 0; i + 1 < trace.block_sequence.size(); i++) {
+                BasicBlock *bb = trace.block_sequence[i];
+                TerminatorBranchTwo *branch = dynamic_cast<TerminatorBranchTwo *>(bb->get_terminator().get());
+                if (branch && branch->get_branch_true().get_referent() == trace.block_sequence[i + 1]
+                    && branch->get_branch_false().get_referent() != trace.block_sequence[i + 1])
+                {
+                    invert_fall_through_branch(*bb, liveness.live_out.at(bb));
+                }
+            }
+        }
+    }
+
     void generate_ir_function_code(IRFunction &ir_function, std::ostream &o) {
         // function header
         o << "define @" << ir_function.get_name() << "(";
@@ -25,11 +99,11 @@ namespace IR::code_gen {
 
         // print each block
         Vec<Trace> traces = trace_cfg(ir_function.get_blocks());
+        invert_fall_through_branches(ir_function, traces);
+        std::string last_prefix = target_arch::new_variable_names(ir_function);
         for (Trace trace: traces) {
-            std::string last_prefix = "";
             for (BasicBlock *bb: trace.block_sequence) {
                 o << "\t" << ":" << bb->get_name() << "\n";
-                last_prefix = target_arch::new_variable_names(ir_function, *bb);
                 for (Uptr<Instruction> &inst : bb->get_inst()) {
                     o << inst->to_l3_inst(last_prefix);
                 }
@@ -76,12 +150,14 @@ namespace IR::code_gen {
     //     o << "\t)\n";
     // }
 
-    void generate_program_code(Program &program, std::ostream &o) {
+    void generate_program_code(Program &program, std::ostream &o, bool optimize_size) {
 		target_arch::mangle_label_names(program);
 
+		std::string outlined_functions = optimize_size ? outline_address_computations(program) : "";
 		for (const Uptr<IRFunction> &function : program.get_ir_functions()) {
 			generate_ir_function_code(*function, o);
 		}
+		o << outlined_functions;
 		o << "\n";
 	}
 }
\ No newline at end of file
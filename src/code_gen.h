@@ -10,5 +10,7 @@ namespace IR::code_gen {
 
 	void generate_ir_function_code(IR::program::IRFunction &ir_function, std::ostream &o);
 
-	void generate_program_code(IR::program::Program &program, std::ostream &o);
+	// When optimizing for size, cold address computations are outlined
+	// into functions of their own.
+	void generate_program_code(IR::program::Program &program, std::ostream &o, bool optimize_size);
 }
\ No newline at end of file
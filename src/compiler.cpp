@@ -1,6 +1,7 @@
 #include "std_alias.h"
 #include "tracer.h"
 #include "code_gen.h"
+#include "optimizer.h"
 #include "parser.h"
 #include <string>
 #include <vector>
@@ -21,7 +22,7 @@
 using namespace std_alias;
 
 void print_help(char *progName) {
-	std::cerr << "Usage: " << progName << " [-v] [-g 0|1] [-O 0|1|2] [-p] SOURCE" << std::endl;
+	std::cerr << "Usage: " << progName << " [-v] [-g 0|1] [-O 0|1|2|s] [-p] SOURCE" << std::endl;
 	return;
 }
 
@@ -33,6 +34,7 @@ int main(
 	bool output_parse_tree = false;
 	bool verbose = false;
 	int32_t optimizationLevel = 3;
+	bool optimize_size = false;
 
 	// Check the compiler arguments.
 	if (argc < 2) {
@@ -45,7 +47,10 @@ int main(
 	while ((option = getopt(argc, argv, "vg:O:p")) != -1) {
 		switch (option) {
 			case 'O':
-				optimizationLevel = strtoul(optarg, NULL, 0);
+				// -Os leaves out the -O2 passes that grow the code, and
+				// outlines cold code
+				optimize_size = strcmp(optarg, "s") == 0;
+				optimizationLevel = optimize_size ? 2 : strtoul(optarg, NULL, 0);
 				break;
 			case 'g':
 				enable_code_generator = (strtoul(optarg, NULL, 0) == 0) ? false : true;
@@ -65,10 +70,11 @@ int main(
 		argv[optind],
 		output_parse_tree ? std::make_optional("parse_tree.dot") : Opt<std::string>()
 	);
+	IR::optimizer::optimize_program(*p, optimizationLevel, optimize_size);
 	if (enable_code_generator) {
 		std::ofstream o;
 		o.open("prog.L3");
-		IR::code_gen::generate_program_code(*p, o);
+		IR::code_gen::generate_program_code(*p, o, optimize_size);
 		o.close();
 	}
 
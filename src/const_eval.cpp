@@ -0,0 +1,314 @@
+#include "const_eval.h"
+#include "analysis.h"
+#include "call_graph.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// the most instructions and terminators one evaluation may run
+	const int64_t max_evaluation_steps = 1 << 20;
+	// the most words of memory one evaluation may allocate
+	const int64_t max_evaluation_words = 1 << 16;
+	// the most calls one evaluation may have in progress at once
+	const int max_evaluation_depth = 256;
+
+	struct Aggregate;
+
+	// a value during evaluation: a number, or a reference to an array or
+	// tuple
+	struct Value {
+		int64_t number;
+		Aggregate *aggregate;
+	};
+
+	struct Aggregate {
+		bool is_tuple;
+		// the arguments it was allocated with (encoded), and the decoded
+		// dimensions
+		Vec<int64_t> args;
+		Vec<int64_t> dims;
+		Vec<Value> elements;
+	};
+
+	Value make_number(int64_t number) {
+		return Value { number, nullptr };
+	}
+
+	// Runs IR functions on known values. Every method returns nothing
+	// once the evaluation has to give up.
+	class Evaluator {
+		int64_t steps_left;
+		int64_t words_left;
+		int depth_left;
+		Vec<Uptr<Aggregate>> heap;
+
+		using Frame = Map<Variable *, Value>;
+
+		public:
+
+		Evaluator() :
+			steps_left { max_evaluation_steps },
+			words_left { max_evaluation_words },
+			depth_left { max_evaluation_depth }
+		{}
+
+		// returns what the function returns, which is 0 for a function
+		// returning nothing
+		Opt<Value> call(IRFunction &ir_function, const Vec<Value> &args) {
+			const Vec<Variable *> &params = ir_function.get_parameter_vars();
+			if (args.size() != params.size() || this->depth_left == 0) {
+				return {};
+			}
+			Frame frame;
+			for (int i = 0; i < params.size(); ++i) {
+				frame[params[i]] = args[i];
+			}
+			this->depth_left--;
+			Opt<Value> result = this->run(ir_function, frame);
+			this->depth_left++;
+			return result;
+		}
+
+		private:
+
+		bool take_step() {
+			return this->steps_left-- > 0;
+		}
+
+		Opt<Value> run(IRFunction &ir_function, Frame &frame) {
+			BasicBlock *bb = ir_function.get_blocks()[0].get();
+			while (true) {
+				for (const Uptr<Instruction> &inst : bb->get_inst()) {
+					if (dynamic_cast<InstructionDeclaration *>(inst.get())) {
+						continue;
+					}
+					if (!this->take_step() || !this->execute(*inst, frame)) {
+						return {};
+					}
+				}
+				if (!this->take_step()) {
+					return {};
+				}
+				Terminator &te = *bb->get_terminator();
+				if (TerminatorBranchOne *branch = dynamic_cast<TerminatorBranchOne *>(&te)) {
+					bb = *branch->get_targets()[0]->get_referent();
+				} else if (TerminatorBranchTwo *branch = dynamic_cast<TerminatorBranchTwo *>(&te)) {
+					// the target only defines branching on 0 and 1
+					Opt<Value> condition = this->get(*branch->get_operands()[0], frame);
+					if (!condition || condition->aggregate || (condition->number != 0 && condition->number != 1)) {
+						return {};
+					}
+					ItemRef<BasicBlock> &target = condition->number ? branch->get_branch_true() : branch->get_branch_false();
+					bb = *target.get_referent();
+				} else if (TerminatorReturnVar *ret = dynamic_cast<TerminatorReturnVar *>(&te)) {
+					return this->get(*ret->get_operands()[0], frame);
+				} else {
+					return make_number(0);
+				}
+			}
+		}
+
+		Opt<Value> get(const Uptr<Expr> &expr, const Frame &frame) {
+			if (Opt<int64_t> number = get_number(expr)) {
+				return make_number(*number);
+			}
+			if (Opt<Variable *> var = get_variable(expr)) {
+				auto it = frame.find(*var);
+				if (it != frame.end()) {
+					return it->second;
+				}
+			}
+			// an unset variable or a function used as a value
+			return {};
+		}
+
+		Opt<Value> evaluate(const Uptr<Expr> &expr, const Frame &frame) {
+			if (BinaryOperation *bin_op = dynamic_cast<BinaryOperation *>(expr.get())) {
+				Opt<Value> lhs = this->get(bin_op->get_lhs(), frame);
+				Opt<Value> rhs = this->get(bin_op->get_rhs(), frame);
+				if (!lhs || !rhs || lhs->aggregate || rhs->aggregate) {
+					return {};
+				}
+				return make_number(evaluate_operator(bin_op->get_operator(), lhs->number, rhs->number));
+			}
+			if (FunctionCall *call = dynamic_cast<FunctionCall *>(expr.get())) {
+				ItemRef<IRFunction> *callee = dynamic_cast<ItemRef<IRFunction> *>(call->get_callee().get());
+				if (!callee || !callee->get_referent()) {
+					return {};
+				}
+				Vec<Value> args;
+				for (const Uptr<Expr> &arg : call->get_arguments()) {
+					Opt<Value> value = this->get(arg, frame);
+					if (!value) {
+						return {};
+					}
+					args.push_back(*value);
+				}
+				return this->call(**callee->get_referent(), args);
+			}
+			return this->get(expr, frame);
+		}
+
+		// returns the element a location refers to, if it is within bounds
+		Opt<Value *> get_element(MemoryLocation &location, const Frame &frame) {
+			auto it = frame.find(*location.get_base().get_referent());
+			if (it == frame.end() || !it->second.aggregate) {
+				return {};
+			}
+			Aggregate &aggregate = *it->second.aggregate;
+			Vec<Uptr<Expr>> &indices = location.get_dimensions();
+			if (indices.size() != aggregate.dims.size()) {
+				return {};
+			}
+			int64_t element = 0;
+			for (int k = 0; k < indices.size(); ++k) {
+				Opt<Value> index = this->get(indices[k], frame);
+				if (!index || index->aggregate || index->number < 0 || index->number >= aggregate.dims[k]) {
+					return {};
+				}
+				element = element * aggregate.dims[k] + index->number;
+			}
+			return &aggregate.elements[element];
+		}
+
+		Opt<Value> allocate(InstructionInitializeArray &allocation, Variable *dest, const Frame &frame) {
+			Uptr<Aggregate> aggregate = mkuptr<Aggregate>();
+			aggregate->is_tuple = dest->get_type().get_a_type() == A_type::tuple;
+			int64_t count = 1;
+			for (const Uptr<Expr> &arg : allocation.get_declaration().get_args()) {
+				Opt<Value> value = this->get(arg, frame);
+				if (!value || value->aggregate || value->number < 1 || value->number % 2 == 0) {
+					return {};
+				}
+				aggregate->args.push_back(value->number);
+				aggregate->dims.push_back(value->number >> 1);
+				if (__builtin_mul_overflow(count, aggregate->dims.back(), &count) || count > this->words_left) {
+					return {};
+				}
+			}
+			// arrays keep their dimensions in memory as well
+			int64_t words = count;
+			if ((!aggregate->is_tuple && __builtin_add_overflow(count, static_cast<int64_t>(aggregate->dims.size()), &words))
+				|| words > this->words_left)
+			{
+				return {};
+			}
+			this->words_left -= words;
+			aggregate->elements.assign(count, make_number(1));
+			Aggregate *result = aggregate.get();
+			this->heap.push_back(mv(aggregate));
+			return Value { 0, result };
+		}
+
+		Opt<Value> get_length(Length &length, const Frame &frame) {
+			auto it = frame.find(*length.get_var().get_referent());
+			if (it == frame.end() || !it->second.aggregate) {
+				return {};
+			}
+			Aggregate &aggregate = *it->second.aggregate;
+			if (Opt<int64_t> dimension = length.get_dim()) {
+				if (aggregate.is_tuple || *dimension < 0 || *dimension >= aggregate.args.size()) {
+					return {};
+				}
+				return make_number(aggregate.args[*dimension]);
+			}
+			int64_t words = aggregate.elements.size();
+			if (!aggregate.is_tuple) {
+				words += aggregate.dims.size();
+			}
+			return make_number((words << 1) + 1);
+		}
+
+		bool execute(Instruction &inst, Frame &frame) {
+			Opt<Value> result;
+			if (InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(&inst)) {
+				result = this->evaluate(assignment->get_source(), frame);
+			} else if (InstructionLoad *load = dynamic_cast<InstructionLoad *>(&inst)) {
+				if (Opt<Value *> element = this->get_element(load->get_location(), frame)) {
+					result = **element;
+				}
+			} else if (InstructionStore *store = dynamic_cast<InstructionStore *>(&inst)) {
+				Opt<Value> value = this->get(store->get_source(), frame);
+				Opt<Value *> element = this->get_element(store->get_location(), frame);
+				if (!value || !element) {
+					return false;
+				}
+				**element = *value;
+				return true;
+			} else if (InstructionLength *length = dynamic_cast<InstructionLength *>(&inst)) {
+				result = this->get_length(length->get_length(), frame);
+			} else if (InstructionInitializeArray *allocation = dynamic_cast<InstructionInitializeArray *>(&inst)) {
+				result = this->allocate(*allocation, *get_def(inst), frame);
+			}
+			if (!result) {
+				return false;
+			}
+			if (Opt<Variable *> def = get_def(inst)) {
+				frame[*def] = *result;
+			}
+			return true;
+		}
+	};
+
+	bool evaluate_constant_calls(Program &program) {
+		call_graph::CallGraph call_graph(program);
+		call_graph::SummaryMap summaries = call_graph::summarize_functions(program, call_graph);
+		// what each function returns for each list of arguments, if it could
+		// be evaluated
+		Map<Pair<IRFunction *, Vec<int64_t>>, Opt<int64_t>> results;
+		bool changed = false;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			for (const Uptr<BasicBlock> &bb : ir_function->get_blocks()) {
+				Vec<Uptr<Instruction>> &insts = bb->get_inst();
+				for (int i = 0; i < insts.size(); ++i) {
+					Opt<IRFunction *> callee = get_called_function(*insts[i]);
+					auto summary = callee ? summaries.find(*callee) : summaries.end();
+					if (summary == summaries.end()
+						|| summary->second.reads_memory
+						|| summary->second.writes_memory
+						|| summary->second.does_io)
+					{
+						continue;
+					}
+					Vec<Uptr<Expr>> &arg_exprs = (*get_call(*insts[i]))->get_arguments();
+					Vec<int64_t> args;
+					for (const Uptr<Expr> &arg : arg_exprs) {
+						if (Opt<int64_t> number = get_number(arg)) {
+							args.push_back(*number);
+						}
+					}
+					if (args.size() != arg_exprs.size()) {
+						continue;
+					}
+
+					auto [it, inserted] = results.emplace(Pair<IRFunction *, Vec<int64_t>> { *callee, args }, Opt<int64_t> {});
+					if (inserted) {
+						Vec<Value> values;
+						for (int64_t arg : args) {
+							values.push_back(make_number(arg));
+						}
+						// arrays are left to be made at runtime
+						Opt<Value> result = Evaluator().call(**callee, values);
+						if (result && !result->aggregate) {
+							it->second = result->number;
+						}
+					}
+					if (!it->second) {
+						continue;
+					}
+					if (Opt<Variable *> dest = get_def(*insts[i])) {
+						insts[i] = mkuptr<InstructionAssignment>(
+							mkuptr<ItemRef<Variable>>(*dest),
+							mkuptr<NumberLiteral>(*it->second)
+						);
+					} else {
+						insts.erase(insts.begin() + i);
+						i--;
+					}
+					changed = true;
+				}
+			}
+		}
+		return changed;
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Compile-time evaluation. A call whose arguments are all numbers, to
+	// a function that neither touches memory its caller can see nor does
+	// I/O, is run by an interpreter inside the compiler. If it returns a
+	// number within a budget of steps, allocated words and call depth,
+	// without calling anything but IR functions or doing anything whose
+	// result the target doesn't define (such as indexing out of bounds),
+	// the call is replaced by that number. Returns whether the program was
+	// changed.
+	bool evaluate_constant_calls(Program &program);
+}
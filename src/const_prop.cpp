@@ -0,0 +1,175 @@
+#include "const_prop.h"
+#include "analysis.h"
+#include "cfg.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// maps each variable known to hold a constant to that constant. a
+	// variable missing from the map may hold any value
+	using ConstantMap = Map<Variable *, int64_t>;
+
+	Opt<int64_t> get_constant(const Uptr<Expr> &expr, const ConstantMap &constants) {
+		if (Opt<int64_t> number = get_number(expr)) {
+			return number;
+		}
+		if (Opt<Variable *> var = get_variable(expr)) {
+			auto it = constants.find(*var);
+			if (it != constants.end()) {
+				return it->second;
+			}
+		}
+		return {};
+	}
+
+	// returns the constant an instruction writes to its destination, if it
+	// always writes the same one
+	Opt<int64_t> evaluate_instruction(Instruction &inst, const ConstantMap &constants) {
+		InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(&inst);
+		if (!assignment) {
+			return {};
+		}
+		Uptr<Expr> &source = assignment->get_source();
+		if (BinaryOperation *bin_op = dynamic_cast<BinaryOperation *>(source.get())) {
+			Opt<int64_t> lhs = get_constant(bin_op->get_lhs(), constants);
+			Opt<int64_t> rhs = get_constant(bin_op->get_rhs(), constants);
+			if (lhs && rhs) {
+				return evaluate_operator(bin_op->get_operator(), *lhs, *rhs);
+			}
+			return {};
+		}
+		return get_constant(source, constants);
+	}
+
+	void transfer(Instruction &inst, ConstantMap &constants) {
+		Opt<Variable *> def = get_def(inst);
+		if (!def) {
+			return;
+		}
+		if (Opt<int64_t> value = evaluate_instruction(inst, constants)) {
+			constants.insert_or_assign(*def, *value);
+		} else {
+			constants.erase(*def);
+		}
+	}
+
+	// Meets the incoming constants into the existing ones, keeping only the
+	// variables that agree. Returns whether dest changed.
+	bool meet_into(ConstantMap &dest, const ConstantMap &incoming) {
+		bool changed = false;
+		for (auto it = dest.begin(); it != dest.end();) {
+			auto incoming_it = incoming.find(it->first);
+			if (incoming_it == incoming.end() || incoming_it->second != it->second) {
+				it = dest.erase(it);
+				changed = true;
+			} else {
+				++it;
+			}
+		}
+		return changed;
+	}
+
+	// returns the successors which control may flow to given the constants
+	// live out of the block
+	Vec<BasicBlock *> get_executable_successors(BasicBlock &bb, const ConstantMap &constants) {
+		Vec<Pair<BasicBlock *, double>> successors = bb.get_terminator()->get_successor();
+		if (dynamic_cast<TerminatorBranchTwo *>(bb.get_terminator().get())) {
+			Opt<int64_t> condition = get_constant(*bb.get_terminator()->get_operands()[0], constants);
+			if (condition) {
+				return { (*condition != 0 ? successors[0] : successors[1]).first };
+			}
+		}
+		Vec<BasicBlock *> result;
+		for (const auto &[succ, weight] : successors) {
+			result.push_back(succ);
+		}
+		return result;
+	}
+
+	// replaces the variables with known values in the slots with those values
+	bool substitute_constants(const Vec<Uptr<Expr> *> &operands, const ConstantMap &constants) {
+		bool changed = false;
+		for (Uptr<Expr> *operand : operands) {
+			if (!get_variable(*operand)) {
+				continue;
+			}
+			if (Opt<int64_t> value = get_constant(*operand, constants)) {
+				*operand = mkuptr<NumberLiteral>(*value);
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	bool fold_instruction(Instruction &inst, const ConstantMap &constants) {
+		bool changed = substitute_constants(inst.get_operands(), constants);
+		if (InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(&inst)) {
+			Uptr<Expr> &source = assignment->get_source();
+			if (dynamic_cast<BinaryOperation *>(source.get())) {
+				if (Opt<int64_t> value = evaluate_instruction(inst, constants)) {
+					source = mkuptr<NumberLiteral>(*value);
+					changed = true;
+				}
+			}
+		}
+		return changed;
+	}
+
+	bool fold_terminator(BasicBlock &bb, const ConstantMap &constants) {
+		bool changed = substitute_constants(bb.get_terminator()->get_operands(), constants);
+		if (dynamic_cast<TerminatorBranchTwo *>(bb.get_terminator().get())) {
+			Vec<BasicBlock *> successors = get_executable_successors(bb, constants);
+			if (successors.size() == 1) {
+				bb.set_terminator(mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(successors[0])));
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	bool propagate_constants(IRFunction &ir_function) {
+		// find the constants at the start of each executable block. a block
+		// missing from the map has not been found to be executable (yet)
+		Map<BasicBlock *, ConstantMap> entry_constants;
+		BasicBlock *entry_block = ir_function.get_blocks()[0].get();
+		entry_constants.emplace(entry_block, ConstantMap {});
+		Vec<BasicBlock *> worklist = { entry_block };
+		while (!worklist.empty()) {
+			BasicBlock *bb = worklist.back();
+			worklist.pop_back();
+
+			ConstantMap constants = entry_constants.at(bb);
+			for (Uptr<Instruction> &inst : bb->get_inst()) {
+				transfer(*inst, constants);
+			}
+			for (BasicBlock *succ : get_executable_successors(*bb, constants)) {
+				auto succ_it = entry_constants.find(succ);
+				if (succ_it == entry_constants.end()) {
+					entry_constants.emplace(succ, constants);
+					worklist.push_back(succ);
+				} else if (meet_into(succ_it->second, constants)) {
+					worklist.push_back(succ);
+				}
+			}
+		}
+
+		// rewrite the executable blocks using the constants found
+		bool changed = false;
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			auto constants_it = entry_constants.find(bb.get());
+			if (constants_it == entry_constants.end()) {
+				continue;
+			}
+			ConstantMap &constants = constants_it->second;
+			for (Uptr<Instruction> &inst : bb->get_inst()) {
+				changed |= fold_instruction(*inst, constants);
+				transfer(*inst, constants);
+			}
+			changed |= fold_terminator(*bb, constants);
+		}
+
+		// blocks that were never executable are now unreachable
+		changed |= cfg::remove_unreachable_blocks(ir_function);
+		return changed;
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Sparse conditional constant propagation. Finds the variables that hold
+	// a known constant on every executable path, substitutes them into
+	// their uses, folds operations and branches whose operands are known,
+	// and removes the blocks that can no longer be reached. Returns whether
+	// the function was changed.
+	bool propagate_constants(IRFunction &ir_function);
+}
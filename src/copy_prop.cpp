@@ -0,0 +1,287 @@
+#include "copy_prop.h"
+#include "analysis.h"
+#include <algorithm>
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// maps each variable known to hold a copy of another variable to that
+	// other variable
+	using CopyMap = Map<Variable *, Variable *>;
+
+	// the type decides how memory accesses through a variable are compiled,
+	// so only variables of the same type may stand in for each other there
+	bool have_same_type(Variable *a, Variable *b) {
+		return a->get_type().to_string() == b->get_type().to_string();
+	}
+
+	// returns the destination and source of a copy between variables
+	Opt<Pair<Variable *, Variable *>> get_copy(Instruction &inst) {
+		InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(&inst);
+		if (!assignment) {
+			return {};
+		}
+		Opt<Variable *> dest = get_def(inst);
+		Opt<Variable *> source = get_variable(assignment->get_source());
+		if (!dest || !source || *dest == *source) {
+			return {};
+		}
+		return Pair<Variable *, Variable *> { *dest, *source };
+	}
+
+	bool substitute_copies(Instruction &inst, const CopyMap &copies) {
+		bool changed = false;
+		for (Uptr<Expr> *operand : inst.get_operands()) {
+			Opt<Variable *> var = get_variable(*operand);
+			if (!var) {
+				continue;
+			}
+			auto copy_it = copies.find(*var);
+			if (copy_it != copies.end()) {
+				*operand = mkuptr<ItemRef<Variable>>(copy_it->second);
+				changed = true;
+			}
+		}
+		if (Opt<ItemRef<Variable> *> array = inst.get_accessed_array()) {
+			auto copy_it = copies.find(*(*array)->get_referent());
+			if (copy_it != copies.end() && have_same_type(copy_it->first, copy_it->second)) {
+				(*array)->bind(copy_it->second);
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	bool substitute_copies(Terminator &te, const CopyMap &copies) {
+		bool changed = false;
+		for (Uptr<Expr> *operand : te.get_operands()) {
+			Opt<Variable *> var = get_variable(*operand);
+			if (!var) {
+				continue;
+			}
+			auto copy_it = copies.find(*var);
+			if (copy_it != copies.end()) {
+				*operand = mkuptr<ItemRef<Variable>>(copy_it->second);
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	void transfer(Instruction &inst, CopyMap &copies) {
+		Opt<Variable *> def = get_def(inst);
+		if (!def) {
+			return;
+		}
+		// redefining either side of a copy breaks it
+		copies.erase(*def);
+		for (auto it = copies.begin(); it != copies.end();) {
+			if (it->second == *def) {
+				it = copies.erase(it);
+			} else {
+				++it;
+			}
+		}
+		if (Opt<Pair<Variable *, Variable *>> copy = get_copy(inst)) {
+			// the source has already been replaced by what it's a copy of
+			auto source_it = copies.find(copy->second);
+			copies.insert_or_assign(copy->first, source_it != copies.end() ? source_it->second : copy->second);
+		}
+	}
+
+	// Meets the incoming copies into the existing ones, keeping only the
+	// copies that hold in both. Returns whether dest changed.
+	bool meet_into(CopyMap &dest, const CopyMap &incoming) {
+		bool changed = false;
+		for (auto it = dest.begin(); it != dest.end();) {
+			auto incoming_it = incoming.find(it->first);
+			if (incoming_it == incoming.end() || incoming_it->second != it->second) {
+				it = dest.erase(it);
+				changed = true;
+			} else {
+				++it;
+			}
+		}
+		return changed;
+	}
+
+	bool propagate_copies(IRFunction &ir_function) {
+		// find the copies that hold at the start of each block. a block
+		// missing from the map has not been reached (yet)
+		Map<BasicBlock *, CopyMap> entry_copies;
+		BasicBlock *entry_block = ir_function.get_blocks()[0].get();
+		entry_copies.emplace(entry_block, CopyMap {});
+		Vec<BasicBlock *> worklist = { entry_block };
+		while (!worklist.empty()) {
+			BasicBlock *bb = worklist.back();
+			worklist.pop_back();
+
+			CopyMap copies = entry_copies.at(bb);
+			for (Uptr<Instruction> &inst : bb->get_inst()) {
+				transfer(*inst, copies);
+			}
+			for (const auto &[succ, weight] : bb->get_successors()) {
+				auto succ_it = entry_copies.find(succ);
+				if (succ_it == entry_copies.end()) {
+					entry_copies.emplace(succ, copies);
+					worklist.push_back(succ);
+				} else if (meet_into(succ_it->second, copies)) {
+					worklist.push_back(succ);
+				}
+			}
+		}
+
+		bool changed = false;
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			auto copies_it = entry_copies.find(bb.get());
+			if (copies_it == entry_copies.end()) {
+				continue;
+			}
+			CopyMap &copies = copies_it->second;
+			for (Uptr<Instruction> &inst : bb->get_inst()) {
+				changed |= substitute_copies(*inst, copies);
+				transfer(*inst, copies);
+			}
+			changed |= substitute_copies(*bb->get_terminator(), copies);
+		}
+		return changed;
+	}
+
+	// Chaitin-style interference: a variable interferes with everything
+	// live where it is defined, except the source if it is defined by a
+	// copy. Parameters and variables read before being written are
+	// defined on entry.
+	class InterferenceGraph {
+		Map<Variable *, Set<Variable *>> edges;
+
+		public:
+
+		explicit InterferenceGraph(IRFunction &ir_function) {
+			Liveness liveness = compute_liveness(ir_function);
+			for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+				Set<Variable *> live = liveness.live_out.at(bb.get());
+				for (Variable *var : get_uses(*bb->get_terminator())) {
+					live.insert(var);
+				}
+				Vec<Uptr<Instruction>> &insts = bb->get_inst();
+				for (auto it = insts.rbegin(); it != insts.rend(); ++it) {
+					Instruction &inst = **it;
+					if (Opt<Variable *> def = get_def(inst)) {
+						Opt<Pair<Variable *, Variable *>> copy = get_copy(inst);
+						for (Variable *var : live) {
+							if (var != *def && (!copy || var != copy->second)) {
+								this->add_edge(*def, var);
+							}
+						}
+						live.erase(*def);
+					}
+					for (Variable *var : get_uses(inst)) {
+						live.insert(var);
+					}
+				}
+			}
+
+			Set<Variable *> entry_defs = liveness.live_in.at(ir_function.get_blocks()[0].get());
+			for (Variable *var : ir_function.get_parameter_vars()) {
+				entry_defs.insert(var);
+			}
+			for (Variable *a : entry_defs) {
+				for (Variable *b : entry_defs) {
+					if (a != b) {
+						this->add_edge(a, b);
+					}
+				}
+			}
+		}
+
+		bool interferes(Variable *a, Variable *b) const {
+			auto it = this->edges.find(a);
+			return it != this->edges.end() && it->second.find(b) != it->second.end();
+		}
+
+		// makes keep interfere with everything remove did
+		void merge(Variable *keep, Variable *remove) {
+			auto it = this->edges.find(remove);
+			if (it == this->edges.end()) {
+				return;
+			}
+			Set<Variable *> neighbours = mv(it->second);
+			this->edges.erase(it);
+			for (Variable *neighbour : neighbours) {
+				this->edges[neighbour].erase(remove);
+				this->add_edge(keep, neighbour);
+			}
+		}
+
+		private:
+
+		void add_edge(Variable *a, Variable *b) {
+			this->edges[a].insert(b);
+			this->edges[b].insert(a);
+		}
+	};
+
+	bool coalesce_copies(IRFunction &ir_function) {
+		InterferenceGraph interference(ir_function);
+		Set<Variable *> parameters;
+		for (Variable *var : ir_function.get_parameter_vars()) {
+			parameters.insert(var);
+		}
+
+		// merge greedily in program order. renames maps each merged
+		// variable to the one that replaces it
+		Map<Variable *, Variable *> renames;
+		auto find = [&](Variable *var) {
+			for (auto it = renames.find(var); it != renames.end(); it = renames.find(var)) {
+				var = it->second;
+			}
+			return var;
+		};
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			for (Uptr<Instruction> &inst : bb->get_inst()) {
+				Opt<Pair<Variable *, Variable *>> copy = get_copy(*inst);
+				if (!copy) {
+					continue;
+				}
+				Variable *dest = find(copy->first);
+				Variable *source = find(copy->second);
+				if (dest == source
+					|| interference.interferes(dest, source)
+					|| !have_same_type(dest, source)
+					|| (parameters.count(dest) && parameters.count(source)))
+				{
+					continue;
+				}
+				// parameters keep their names, as the caller binds them
+				if (parameters.count(dest)) {
+					std::swap(dest, source);
+				}
+				interference.merge(source, dest);
+				renames.emplace(dest, source);
+			}
+		}
+		for (auto &[var, replacement] : renames) {
+			replacement = find(replacement);
+		}
+
+		bool changed = !renames.empty();
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			Vec<Uptr<Instruction>> &insts = bb->get_inst();
+			for (Uptr<Instruction> &inst : insts) {
+				replace_variables(*inst, renames);
+			}
+			replace_variables(*bb->get_terminator(), renames);
+			// copies between merged variables (or left over from other
+			// passes) now do nothing
+			size_t num_insts = insts.size();
+			insts.erase(std::remove_if(insts.begin(), insts.end(), [](const Uptr<Instruction> &inst) {
+				InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(inst.get());
+				return assignment
+					&& get_def(*inst)
+					&& get_variable(assignment->get_source()) == get_def(*inst);
+			}), insts.end());
+			changed |= insts.size() != num_insts;
+		}
+		return changed;
+	}
+}
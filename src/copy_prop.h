@@ -0,0 +1,20 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Global copy propagation. Wherever a copy `%a <- %b` is known to still
+	// hold, uses of %a are replaced by %b, which usually leaves the copy
+	// dead. Returns whether the function was changed.
+	bool propagate_copies(IRFunction &ir_function);
+
+	// Copy coalescing. The two sides of a copy are merged into a single
+	// variable if their live ranges don't interfere, which turns the copy
+	// into a no-op that is removed. Meant to run after everything else, as
+	// it makes variables live longer. Returns whether the function was
+	// changed.
+	bool coalesce_copies(IRFunction &ir_function);
+}
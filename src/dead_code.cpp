@@ -0,0 +1,148 @@
+#include "dead_code.h"
+#include "analysis.h"
+#include "cfg.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	bool eliminate_dead_code(IRFunction &ir_function, const call_graph::SummaryMap &summaries) {
+		Set<Variable *> local_arrays = get_non_escaping_arrays(ir_function);
+
+		// if some block can never return then the post-dominator tree does
+		// not cover it, so conservatively treat every branch as useful
+		cfg::DominatorTree post_dominators = cfg::make_post_dominator_tree(ir_function);
+		bool all_blocks_return = true;
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			all_blocks_return &= post_dominators.contains(block.get());
+		}
+		Map<BasicBlock *, Set<BasicBlock *>> control_dependences;
+		if (all_blocks_return) {
+			control_dependences = post_dominators.get_frontiers();
+		}
+
+		// find which definitions each instruction and terminator depends on
+		Map<BasicBlock *, DefinitionMap> reaching_definitions = compute_reaching_definitions(ir_function);
+		Map<Instruction *, BasicBlock *> inst_blocks;
+		Map<Instruction *, Set<Instruction *>> inst_dependences;
+		Map<BasicBlock *, Set<Instruction *>> terminator_dependences;
+		Map<Variable *, Vec<Instruction *>> local_array_stores;
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			DefinitionMap &definitions = reaching_definitions.at(block.get());
+			for (const Uptr<Instruction> &inst : block->get_inst()) {
+				inst_blocks[inst.get()] = block.get();
+				Set<Instruction *> &dependences = inst_dependences[inst.get()];
+				for (Variable *var : get_uses(*inst)) {
+					dependences += definitions[var];
+				}
+				if (dynamic_cast<InstructionStore *>(inst.get())) {
+					Variable *array = *(*inst->get_accessed_array())->get_referent();
+					if (local_arrays.find(array) != local_arrays.end()) {
+						local_array_stores[array].push_back(inst.get());
+					}
+				}
+				transfer_reaching_definitions(*inst, definitions);
+			}
+			Set<Instruction *> &dependences = terminator_dependences[block.get()];
+			for (Variable *var : get_uses(*block->get_terminator())) {
+				dependences += definitions[var];
+			}
+		}
+
+		// mark everything useful, starting from the roots
+		Set<Instruction *> live_insts;
+		Set<BasicBlock *> live_terminators;
+		Vec<Instruction *> inst_worklist;
+		Vec<BasicBlock *> terminator_worklist;
+		auto mark_inst = [&](Instruction *inst) {
+			if (live_insts.insert(inst).second) {
+				inst_worklist.push_back(inst);
+			}
+		};
+		auto mark_terminator = [&](BasicBlock *block) {
+			if (live_terminators.insert(block).second) {
+				terminator_worklist.push_back(block);
+			}
+		};
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			for (const Uptr<Instruction> &inst : block->get_inst()) {
+				if (InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(inst.get())) {
+					FunctionCall *call = dynamic_cast<FunctionCall *>(assignment->get_source().get());
+					if (call && call_graph::get_call_summary(*call, summaries).has_side_effects()) {
+						mark_inst(inst.get());
+					}
+				} else if (dynamic_cast<InstructionStore *>(inst.get())) {
+					Variable *array = *(*inst->get_accessed_array())->get_referent();
+					if (local_arrays.find(array) == local_arrays.end()) {
+						mark_inst(inst.get());
+					}
+				}
+			}
+			if (!all_blocks_return || block->get_successors().empty()) {
+				mark_terminator(block.get());
+			}
+		}
+		// removing a loop could turn a program that never halts into one
+		// that does, so keep the branches that go around every loop
+		for (const auto &[from, to] : cfg::get_retreating_edges(ir_function)) {
+			mark_terminator(from);
+		}
+		while (!inst_worklist.empty() || !terminator_worklist.empty()) {
+			if (!inst_worklist.empty()) {
+				Instruction *inst = inst_worklist.back();
+				inst_worklist.pop_back();
+				for (Instruction *dependence : inst_dependences.at(inst)) {
+					mark_inst(dependence);
+				}
+				for (BasicBlock *controller : control_dependences[inst_blocks.at(inst)]) {
+					mark_terminator(controller);
+				}
+				if (dynamic_cast<InstructionLoad *>(inst)) {
+					Variable *array = *(*inst->get_accessed_array())->get_referent();
+					for (Instruction *store : local_array_stores[array]) {
+						mark_inst(store);
+					}
+				}
+			} else {
+				BasicBlock *block = terminator_worklist.back();
+				terminator_worklist.pop_back();
+				for (Instruction *dependence : terminator_dependences.at(block)) {
+					mark_inst(dependence);
+				}
+				for (BasicBlock *controller : control_dependences[block]) {
+					mark_terminator(controller);
+				}
+			}
+		}
+
+		// sweep away everything that wasn't marked
+		bool changed = false;
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			Vec<Uptr<Instruction>> &insts = block->get_inst();
+			auto remove_begin = std::remove_if(
+				insts.begin(),
+				insts.end(),
+				[&](const Uptr<Instruction> &inst) {
+					// declarations own their variables, so they must stay
+					return !dynamic_cast<InstructionDeclaration *>(inst.get())
+						&& live_insts.find(inst.get()) == live_insts.end();
+				}
+			);
+			changed |= remove_begin != insts.end();
+			insts.erase(remove_begin, insts.end());
+
+			// nothing useful depends on which way a dead branch goes, so go
+			// straight to the first block that both ways would reach
+			if (live_terminators.find(block.get()) == live_terminators.end()
+				&& dynamic_cast<TerminatorBranchTwo *>(block->get_terminator().get()))
+			{
+				Opt<BasicBlock *> post_dominator = post_dominators.get_idom(block.get());
+				if (post_dominator && *post_dominator) {
+					block->set_terminator(mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(*post_dominator)));
+					changed = true;
+				}
+			}
+		}
+		changed |= cfg::remove_unreachable_blocks(ir_function);
+		return changed;
+	}
+}
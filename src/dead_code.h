@@ -0,0 +1,18 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+#include "call_graph.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Aggressive dead code elimination. Only calls with side effects,
+	// stores to memory that can be seen outside the function, returns and
+	// the branches that keep loops looping are assumed to be useful;
+	// everything else is removed unless something useful depends on it,
+	// either through its value or through control dependence. Stores to
+	// arrays that never escape are only kept if the array is read. Returns
+	// whether the function was changed.
+	bool eliminate_dead_code(IRFunction &ir_function, const call_graph::SummaryMap &summaries);
+}
@@ -0,0 +1,402 @@
+#include "dependence.h"
+#include "analysis.h"
+#include <limits>
+#include <numeric>
+
+namespace IR::analysis {
+	// returns a + b * factor, if no coefficient overflows
+	Opt<AffineExpr> add_scaled(const AffineExpr &a, const AffineExpr &b, int64_t factor) {
+		AffineExpr result = a;
+		int64_t scaled;
+		if (__builtin_mul_overflow(b.constant, factor, &scaled)
+			|| __builtin_add_overflow(result.constant, scaled, &result.constant))
+		{
+			return {};
+		}
+		for (const auto &[var, coefficient] : b.coefficients) {
+			int64_t &sum = result.coefficients[var];
+			if (__builtin_mul_overflow(coefficient, factor, &scaled) || __builtin_add_overflow(sum, scaled, &sum)) {
+				return {};
+			}
+			if (sum == 0) {
+				result.coefficients.erase(var);
+			}
+		}
+		return result;
+	}
+
+	AffineExpr make_affine_constant(int64_t value) {
+		return AffineExpr { {}, value };
+	}
+
+	AffineExpr make_affine_variable(Variable *var) {
+		return AffineExpr { { { var, 1 } }, 0 };
+	}
+
+	// Tracks the affine form of the variables through one block of a loop
+	// nest. At the start of the block, an induction variable holds its
+	// value in the current iteration unless it has already been stepped.
+	struct AffineValues {
+		// the induction variables holding their value in the current
+		// iteration at the start of the block
+		Set<Variable *> current_induction_vars;
+		const Set<Variable *> &nest_defs;
+		Map<Variable *, Opt<AffineExpr>> values;
+
+		Opt<AffineExpr> get(const Uptr<Expr> &expr) const {
+			if (Opt<int64_t> number = get_number(expr)) {
+				return make_affine_constant(*number);
+			}
+			Opt<Variable *> var = get_variable(expr);
+			if (!var) {
+				return {};
+			}
+			auto it = this->values.find(*var);
+			if (it != this->values.end()) {
+				return it->second;
+			}
+			if (this->current_induction_vars.count(*var) || !this->nest_defs.count(*var)) {
+				return make_affine_variable(*var);
+			}
+			return {};
+		}
+
+		Opt<AffineExpr> evaluate(const Uptr<Expr> &expr) const {
+			BinaryOperation *bin_op = dynamic_cast<BinaryOperation *>(expr.get());
+			if (!bin_op) {
+				return this->get(expr);
+			}
+			Opt<AffineExpr> lhs = this->get(bin_op->get_lhs());
+			Opt<AffineExpr> rhs = this->get(bin_op->get_rhs());
+			if (!lhs || !rhs) {
+				return {};
+			}
+			switch (bin_op->get_operator()) {
+				case Operator::plus: return add_scaled(*lhs, *rhs, 1);
+				case Operator::minus: return add_scaled(*lhs, *rhs, -1);
+				case Operator::times:
+					if (rhs->coefficients.empty()) {
+						return add_scaled(make_affine_constant(0), *lhs, rhs->constant);
+					}
+					if (lhs->coefficients.empty()) {
+						return add_scaled(make_affine_constant(0), *rhs, lhs->constant);
+					}
+					return {};
+				case Operator::lshift:
+					if (rhs->coefficients.empty() && rhs->constant >= 0 && rhs->constant < 63) {
+						return add_scaled(make_affine_constant(0), *lhs, int64_t(1) << rhs->constant);
+					}
+					return {};
+				default: return {};
+			}
+		}
+
+		void transfer(Instruction &inst) {
+			Opt<Variable *> def = get_def(inst);
+			if (!def) {
+				return;
+			}
+			InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(&inst);
+			this->values[*def] = assignment ? this->evaluate(assignment->get_source()) : Opt<AffineExpr> {};
+		}
+	};
+
+	// returns the blocks of the loop that may run after the induction
+	// variable has been stepped and before the loop's next iteration starts
+	Set<BasicBlock *> find_blocks_after_step(const NestedLoop &level) {
+		Set<BasicBlock *> result;
+		Vec<BasicBlock *> stack;
+		for (auto [bb, index] : find_loop_defs(*level.loop, level.counted->induction_var)) {
+			stack.push_back(bb);
+		}
+		while (!stack.empty()) {
+			BasicBlock *bb = stack.back();
+			stack.pop_back();
+			for (auto [succ, probability] : bb->get_successors()) {
+				if (level.loop->contains(succ) && succ != level.loop->header && result.insert(succ).second) {
+					stack.push_back(succ);
+				}
+			}
+		}
+		return result;
+	}
+
+	Opt<Vec<MemoryAccess>> find_memory_accesses(IRFunction &ir_function, const Vec<NestedLoop> &nest) {
+		const cfg::Loop &outer = *nest[0].loop;
+		Set<Variable *> nest_defs = find_written_variables(outer);
+		Set<Variable *> unaliased_arrays = get_non_escaping_arrays(ir_function);
+		Vec<Set<BasicBlock *>> blocks_after_step;
+		for (const NestedLoop &level : nest) {
+			blocks_after_step.push_back(find_blocks_after_step(level));
+		}
+		Vec<MemoryAccess> accesses;
+		for (BasicBlock *bb : outer.blocks) {
+			AffineValues values { {}, nest_defs, {} };
+			for (int i = 0; i < nest.size(); ++i) {
+				if (nest[i].loop->contains(bb) && !blocks_after_step[i].count(bb)) {
+					values.current_induction_vars.insert(nest[i].counted->induction_var);
+				}
+			}
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				if (get_call(*inst)) {
+					return {};
+				}
+				MemoryLocation *location = nullptr;
+				bool is_store = false;
+				if (InstructionLoad *load = dynamic_cast<InstructionLoad *>(inst.get())) {
+					location = &load->get_location();
+				} else if (InstructionStore *store = dynamic_cast<InstructionStore *>(inst.get())) {
+					location = &store->get_location();
+					is_store = true;
+				}
+				if (location) {
+					Variable *array = *location->get_base().get_referent();
+					if (nest_defs.count(array)) {
+						return {};
+					}
+					Vec<Opt<AffineExpr>> indices;
+					for (const Uptr<Expr> &index : location->get_dimensions()) {
+						indices.push_back(values.get(index));
+					}
+					accesses.push_back(MemoryAccess { array, unaliased_arrays.count(array) > 0, is_store, mv(indices) });
+				}
+				values.transfer(*inst);
+			}
+		}
+		return accesses;
+	}
+
+	// Returns whether `sum of coefficients[k] * distances[k] = constant`
+	// may have a solution whose distances go in the given directions. The
+	// coefficients and constant of each equation are given, and distances
+	// are counted in iterations.
+	bool may_solve(Vec<Pair<Vec<int64_t>, int64_t>> equations, const Vec<Direction> &directions) {
+		int n = directions.size();
+		Vec<Opt<int64_t>> distances(n);
+		for (int k = 0; k < n; ++k) {
+			if (directions[k] == Direction::same) {
+				distances[k] = 0;
+			}
+		}
+		// an equation with a single unknown left decides it, which may
+		// leave a single unknown in another one
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (auto &[coefficients, constant] : equations) {
+				int free = -1;
+				int free_count = 0;
+				for (int k = 0; k < n; ++k) {
+					if (coefficients[k] == 0) {
+						continue;
+					}
+					if (distances[k]) {
+						int64_t known;
+						if (__builtin_mul_overflow(coefficients[k], *distances[k], &known)
+							|| __builtin_sub_overflow(constant, known, &constant))
+						{
+							return true;
+						}
+						coefficients[k] = 0;
+						continue;
+					}
+					free = k;
+					free_count++;
+				}
+				if (free_count == 0 && constant != 0) {
+					return false;
+				}
+				if (free_count != 1) {
+					continue;
+				}
+				int64_t coefficient = coefficients[free];
+				if (constant == std::numeric_limits<int64_t>::min()) {
+					return true;
+				}
+				if (constant % coefficient != 0) {
+					return false;
+				}
+				int64_t distance = constant / coefficient;
+				if ((directions[free] == Direction::forward && distance <= 0)
+					|| (directions[free] == Direction::backward && distance >= 0))
+				{
+					return false;
+				}
+				distances[free] = distance;
+				coefficients[free] = 0;
+				constant = 0;
+				changed = true;
+			}
+		}
+		// the equations left have several unknowns, which can only add up
+		// to multiples of their greatest common divisor
+		for (const auto &[coefficients, constant] : equations) {
+			int64_t divisor = 0;
+			for (int64_t coefficient : coefficients) {
+				divisor = std::gcd(divisor, coefficient);
+			}
+			if (divisor != 0 && constant % divisor != 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool may_depend(
+		const MemoryAccess &source,
+		const MemoryAccess &sink,
+		const Vec<NestedLoop> &nest,
+		const Vec<Direction> &directions
+	) {
+		Type &source_type = source.array->get_type();
+		Type &sink_type = sink.array->get_type();
+		if (source_type.get_a_type() != sink_type.get_a_type()
+			|| source_type.get_num_dimensions() != sink_type.get_num_dimensions()
+			|| source.indices.size() != sink.indices.size())
+		{
+			return false;
+		}
+		if (source.array != sink.array && (source.is_unaliased || sink.is_unaliased)) {
+			return false;
+		}
+
+		// Both touch the same element if each index of the source in the
+		// first iteration equals that of the sink in the second. With
+		// `index = c + sum of a * iv`, that's `sum of a * step * distance =
+		// source c - sink c` for an index that depends on the induction
+		// variables in the same way in both.
+		Vec<Pair<Vec<int64_t>, int64_t>> equations;
+		for (int d = 0; d < source.indices.size(); ++d) {
+			const Opt<AffineExpr> &source_index = source.indices[d];
+			const Opt<AffineExpr> &sink_index = sink.indices[d];
+			if (!source_index || !sink_index || source_index->coefficients != sink_index->coefficients) {
+				continue;
+			}
+			Vec<int64_t> coefficients;
+			for (const NestedLoop &level : nest) {
+				auto it = sink_index->coefficients.find(level.counted->induction_var);
+				int64_t coefficient = it == sink_index->coefficients.end() ? 0 : it->second;
+				if (__builtin_mul_overflow(coefficient, level.counted->step, &coefficient)
+					|| coefficient == std::numeric_limits<int64_t>::min())
+				{
+					return true;
+				}
+				coefficients.push_back(coefficient);
+			}
+			int64_t constant;
+			if (__builtin_sub_overflow(source_index->constant, sink_index->constant, &constant)) {
+				return true;
+			}
+			equations.emplace_back(mv(coefficients), constant);
+		}
+		return may_solve(mv(equations), directions);
+	}
+
+	// the operators whose results don't depend on the order of their
+	// operands, or of a chain of them
+	enum class Reduction {
+		sum,
+		product,
+		conjunction
+	};
+
+	Opt<Reduction> get_reduction(Operator op) {
+		switch (op) {
+			case Operator::plus:
+			case Operator::minus: return Reduction::sum;
+			case Operator::times: return Reduction::product;
+			case Operator::bitwise_and: return Reduction::conjunction;
+			default: return {};
+		}
+	}
+
+	bool is_reduction(const cfg::Loop &loop, Variable *var) {
+		Opt<Reduction> reduction;
+		for (BasicBlock *bb : loop.blocks) {
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				if (get_def(*inst) != var) {
+					if (uses_variable(*inst, var)) {
+						return false;
+					}
+					continue;
+				}
+				InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(inst.get());
+				BinaryOperation *bin_op = assignment ? dynamic_cast<BinaryOperation *>(assignment->get_source().get()) : nullptr;
+				if (!bin_op || get_variable(bin_op->get_lhs()) != var || get_variable(bin_op->get_rhs()) == var) {
+					return false;
+				}
+				Opt<Reduction> inst_reduction = get_reduction(bin_op->get_operator());
+				if (!inst_reduction || (reduction && reduction != inst_reduction)) {
+					return false;
+				}
+				reduction = inst_reduction;
+			}
+			Vec<Variable *> uses = get_uses(*bb->get_terminator());
+			if (std::find(uses.begin(), uses.end(), var) != uses.end()) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Returns whether running the iterations of the nest in the other
+	// order leaves every variable used afterwards with the same value, and
+	// every iteration sees the same values in the variables it reads.
+	bool can_reorder_variables(IRFunction &ir_function, const PerfectNest &nest) {
+		Liveness liveness = compute_liveness(ir_function);
+		Variable *outer_var = nest.outer_counted.induction_var;
+		Variable *inner_var = nest.inner_counted.induction_var;
+		const Set<Variable *> &live_after = liveness.live_in.at(nest.outer_counted.exit);
+		if (live_after.count(outer_var) || live_after.count(inner_var)) {
+			return false;
+		}
+		// the headers' conditions are computed differently afterwards
+		for (BasicBlock *header : { nest.outer.header, nest.inner.header }) {
+			Opt<Variable *> condition = get_def(*header->get_inst()[0]);
+			if (!condition || liveness.live_out.at(header).count(*condition)) {
+				return false;
+			}
+		}
+		// any other variable carried from one iteration to the next must be
+		// a reduction
+		for (Variable *var : find_written_variables(nest.inner)) {
+			if (var != inner_var && liveness.live_in.at(nest.inner.header).count(var) && !is_reduction(nest.outer, var)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// returns whether no access depends on one made in an earlier
+	// iteration of the outer loop but a later iteration of the inner loop
+	bool can_reorder_memory(const Vec<MemoryAccess> &accesses, const Vec<NestedLoop> &levels) {
+		for (const MemoryAccess &source : accesses) {
+			for (const MemoryAccess &sink : accesses) {
+				if ((source.is_store || sink.is_store)
+					&& may_depend(source, sink, levels, { Direction::forward, Direction::backward }))
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool can_interchange(IRFunction &ir_function, const PerfectNest &nest, const Vec<MemoryAccess> &accesses) {
+		return can_reorder_memory(accesses, nest.get_levels()) && can_reorder_variables(ir_function, nest);
+	}
+
+	int count_strided_accesses(const Vec<MemoryAccess> &accesses, Variable *var) {
+		int count = 0;
+		for (const MemoryAccess &access : accesses) {
+			for (int d = 0; d + 1 < access.indices.size(); ++d) {
+				const Opt<AffineExpr> &index = access.indices[d];
+				if (index && index->coefficients.count(var)) {
+					count++;
+					break;
+				}
+			}
+		}
+		return count;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+#include "cfg.h"
+#include "loop_analysis.h"
+
+namespace IR::analysis {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// A value of the form `constant + sum of coefficient * variable`. Each
+	// variable is either an induction variable of a loop nest, standing for
+	// its value in the current iteration, or doesn't change inside the nest.
+	struct AffineExpr {
+		Map<Variable *, int64_t> coefficients;
+		int64_t constant;
+	};
+
+	// An element of an array or tuple read or written inside a loop nest.
+	// An index without an affine form may have any value.
+	struct MemoryAccess {
+		Variable *array;
+		// whether no other variable can refer to the array
+		bool is_unaliased;
+		bool is_store;
+		Vec<Opt<AffineExpr>> indices;
+	};
+
+	// Returns the memory accesses made in a loop nest, given outermost loop
+	// first. Returns nothing if the nest touches memory in other ways, such
+	// as by calling a function or through an array that is reassigned
+	// inside the nest.
+	Opt<Vec<MemoryAccess>> find_memory_accesses(IRFunction &ir_function, const Vec<NestedLoop> &nest);
+
+	// which way one loop of a nest moves between two iterations of the nest
+	enum class Direction {
+		forward,
+		same,
+		backward,
+		any
+	};
+
+	// Returns whether source, made in one iteration of the nest, and sink,
+	// made in another one, may touch the same element, where each loop
+	// moves in the given direction from the first iteration to the second.
+	// Arrays of the same type may be the same array, unless one of them
+	// can't be referred to by another variable.
+	bool may_depend(
+		const MemoryAccess &source,
+		const MemoryAccess &sink,
+		const Vec<NestedLoop> &nest,
+		const Vec<Direction> &directions
+	);
+
+	// Returns whether the loop only uses var to fold values into it, all
+	// in the same way (`var <- var + x`), so the order of its iterations
+	// doesn't change its final value.
+	bool is_reduction(const cfg::Loop &loop, Variable *var);
+
+	// Returns whether the iterations of a perfect nest may run with its
+	// loops swapped. No access may depend on one made in an earlier
+	// iteration of the outer loop but a later iteration of the inner loop,
+	// as their order would flip. Any other value carried between
+	// iterations must be a reduction, and the induction variables and the
+	// headers' conditions must not be used outside the loops.
+	bool can_interchange(IRFunction &ir_function, const PerfectNest &nest, const Vec<MemoryAccess> &accesses);
+
+	// returns how many accesses to a multi-dimensional array step through
+	// an index other than the last one as var changes
+	int count_strided_accesses(const Vec<MemoryAccess> &accesses, Variable *var);
+}
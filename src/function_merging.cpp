@@ -0,0 +1,216 @@
+#include "function_merging.h"
+#include "analysis.h"
+#include <algorithm>
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// Writes out a function in a form that only depends on its structure.
+	// Variables are numbered in the order they first appear (parameters
+	// first) and blocks by their position, so two functions have the same
+	// key exactly when they only differ in those names.
+	class FunctionKey {
+		IRFunction &ir_function;
+		Map<Variable *, int> variable_numbers;
+		Map<BasicBlock *, int> block_numbers;
+		std::string key;
+		// whether the function has something the key can't describe
+		bool is_unknown;
+
+		public:
+
+		explicit FunctionKey(IRFunction &ir_function) : ir_function { ir_function }, is_unknown { false } {
+			const Vec<Uptr<BasicBlock>> &blocks = ir_function.get_blocks();
+			for (int i = 0; i < blocks.size(); ++i) {
+				this->block_numbers.emplace(blocks[i].get(), i);
+			}
+			this->key += ir_function.get_ret_type().to_string() + "(";
+			for (Variable *param : ir_function.get_parameter_vars()) {
+				this->key += param->get_type().to_string() + " ";
+				this->add_variable(param);
+			}
+			this->key += ")\n";
+			for (const Uptr<BasicBlock> &bb : blocks) {
+				for (const Uptr<Instruction> &inst : bb->get_inst()) {
+					this->add_instruction(*inst);
+					this->key += "\n";
+				}
+				this->add_terminator(*bb->get_terminator());
+				this->key += "\n";
+			}
+		}
+
+		Opt<std::string> get() const {
+			if (this->is_unknown) {
+				return {};
+			}
+			return this->key;
+		}
+
+		private:
+
+		void add_variable(Variable *var) {
+			auto [it, inserted] = this->variable_numbers.emplace(var, this->variable_numbers.size());
+			this->key += "%" + std::to_string(it->second) + " ";
+		}
+
+		void add_expr(const Uptr<Expr> &expr) {
+			if (Opt<int64_t> number = get_number(expr)) {
+				this->key += std::to_string(*number) + " ";
+			} else if (Opt<Variable *> var = get_variable(expr)) {
+				this->add_variable(*var);
+			} else if (ItemRef<BasicBlock> *block = dynamic_cast<ItemRef<BasicBlock> *>(expr.get())) {
+				this->key += ":" + std::to_string(this->block_numbers.at(*block->get_referent())) + " ";
+			} else if (ItemRef<IRFunction> *callee = dynamic_cast<ItemRef<IRFunction> *>(expr.get())) {
+				IRFunction *referent = *callee->get_referent();
+				this->key += referent == &this->ir_function ? "@ " : "@" + referent->get_name() + " ";
+			} else if (ItemRef<ExternalFunction> *callee = dynamic_cast<ItemRef<ExternalFunction> *>(expr.get())) {
+				this->key += callee->get_ref_name() + " ";
+			} else if (BinaryOperation *bin_op = dynamic_cast<BinaryOperation *>(expr.get())) {
+				this->add_expr(bin_op->get_lhs());
+				this->key += op_to_string(bin_op->get_operator()) + " ";
+				this->add_expr(bin_op->get_rhs());
+			} else if (FunctionCall *call = dynamic_cast<FunctionCall *>(expr.get())) {
+				this->key += call->is_tail_call() ? "tail call " : "call ";
+				this->add_expr(call->get_callee());
+				this->key += "( ";
+				for (const Uptr<Expr> &arg : call->get_arguments()) {
+					this->add_expr(arg);
+				}
+				this->key += ") ";
+			} else {
+				this->is_unknown = true;
+			}
+		}
+
+		void add_location(MemoryLocation &location) {
+			this->add_variable(*location.get_base().get_referent());
+			for (const Uptr<Expr> &index : location.get_dimensions()) {
+				this->key += "[ ";
+				this->add_expr(index);
+				this->key += "] ";
+			}
+		}
+
+		void add_instruction(Instruction &inst) {
+			if (InstructionDeclaration *decl = dynamic_cast<InstructionDeclaration *>(&inst)) {
+				Variable *var = *decl->get_referent();
+				this->key += var->get_type().to_string() + " ";
+				this->add_variable(var);
+				return;
+			}
+			if (Opt<Variable *> def = get_def(inst)) {
+				this->add_variable(*def);
+				this->key += "<- ";
+			}
+			if (InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(&inst)) {
+				this->add_expr(assignment->get_source());
+			} else if (InstructionStore *store = dynamic_cast<InstructionStore *>(&inst)) {
+				this->add_location(store->get_location());
+				this->key += "<- ";
+				this->add_expr(store->get_source());
+			} else if (InstructionLoad *load = dynamic_cast<InstructionLoad *>(&inst)) {
+				this->add_location(load->get_location());
+			} else if (InstructionLength *length = dynamic_cast<InstructionLength *>(&inst)) {
+				this->key += "length ";
+				this->add_variable(*length->get_length().get_var().get_referent());
+				if (Opt<int64_t> dimension = length->get_length().get_dim()) {
+					this->key += std::to_string(*dimension);
+				}
+			} else if (InstructionInitializeArray *allocation = dynamic_cast<InstructionInitializeArray *>(&inst)) {
+				this->key += "new ( ";
+				for (const Uptr<Expr> &arg : allocation->get_declaration().get_args()) {
+					this->add_expr(arg);
+				}
+				this->key += ")";
+			} else {
+				this->is_unknown = true;
+			}
+		}
+
+		void add_terminator(Terminator &te) {
+			if (dynamic_cast<TerminatorBranchOne *>(&te) || dynamic_cast<TerminatorBranchTwo *>(&te)) {
+				this->key += "br ";
+			} else if (dynamic_cast<TerminatorReturnVoid *>(&te) || dynamic_cast<TerminatorReturnVar *>(&te)) {
+				this->key += "return ";
+			} else {
+				this->is_unknown = true;
+			}
+			for (Uptr<Expr> *operand : te.get_operands()) {
+				this->add_expr(*operand);
+			}
+			for (ItemRef<BasicBlock> *target : te.get_targets()) {
+				this->key += ":" + std::to_string(this->block_numbers.at(*target->get_referent())) + " ";
+			}
+		}
+	};
+
+	// makes every reference to a function in the map refer to the function
+	// it maps to instead
+	void redirect_references(Program &program, const Map<IRFunction *, IRFunction *> &replacements) {
+		auto redirect = [&](Uptr<Expr> *operand) {
+			ItemRef<IRFunction> *ref = dynamic_cast<ItemRef<IRFunction> *>(operand->get());
+			if (!ref) {
+				return;
+			}
+			auto it = replacements.find(*ref->get_referent());
+			if (it != replacements.end()) {
+				ref->bind(it->second);
+			}
+		};
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			for (const Uptr<BasicBlock> &bb : ir_function->get_blocks()) {
+				for (const Uptr<Instruction> &inst : bb->get_inst()) {
+					for (Uptr<Expr> *operand : inst->get_operands()) {
+						redirect(operand);
+					}
+				}
+				for (Uptr<Expr> *operand : bb->get_terminator()->get_operands()) {
+					redirect(operand);
+				}
+			}
+		}
+	}
+
+	// Merges each group of identical functions into its first member.
+	// Returns whether any was merged.
+	bool merge_once(Program &program) {
+		Vec<Uptr<IRFunction>> &ir_functions = program.get_ir_functions();
+		// @main is looked at first so that it is the one kept
+		Vec<IRFunction *> order;
+		for (const Uptr<IRFunction> &ir_function : ir_functions) {
+			order.push_back(ir_function.get());
+		}
+		std::stable_partition(order.begin(), order.end(), [](IRFunction *ir_function) {
+			return ir_function->get_name() == "main";
+		});
+		Map<std::string, IRFunction *> survivors;
+		Map<IRFunction *, IRFunction *> replacements;
+		for (IRFunction *ir_function : order) {
+			Opt<std::string> key = FunctionKey(*ir_function).get();
+			if (!key) {
+				continue;
+			}
+			auto [it, inserted] = survivors.emplace(mv(*key), ir_function);
+			if (!inserted) {
+				replacements.emplace(ir_function, it->second);
+			}
+		}
+		if (replacements.empty()) {
+			return false;
+		}
+		redirect_references(program, replacements);
+		ir_functions.erase(std::remove_if(ir_functions.begin(), ir_functions.end(), [&](const Uptr<IRFunction> &ir_function) {
+			return replacements.find(ir_function.get()) != replacements.end();
+		}), ir_functions.end());
+		return true;
+	}
+
+	bool merge_identical_functions(Program &program) {
+		bool changed = false;
+		while (merge_once(program)) {
+			changed = true;
+		}
+		return changed;
+	}
+}
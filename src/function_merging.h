@@ -0,0 +1,17 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Identical function merging. Functions whose bodies are the same up
+	// to the names of their variables and labels (and whose recursive calls
+	// call themselves) are merged: every reference to one of them refers to
+	// the first of them instead, which is @main if it is among them, and
+	// the others are removed. Merging can make their callers identical in
+	// turn, so this repeats until nothing is merged. Returns whether the
+	// program was changed.
+	bool merge_identical_functions(Program &program);
+}
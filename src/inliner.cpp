@@ -0,0 +1,239 @@
+#include "inliner.h"
+#include "analysis.h"
+#include "call_graph.h"
+#include "cfg.h"
+#include "tracer.h"
+#include <algorithm>
+#include <functional>
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// callees this small cost no more than the call itself
+	const int64_t trivial_callee_size = 4;
+
+	// Returns the biggest callee worth inlining at a call site. hotness is
+	// the rank of the call site relative to an average block of the caller.
+	int64_t get_size_threshold(int32_t opt_level, double hotness) {
+		return static_cast<int64_t>(8 * opt_level * std::clamp(hotness, 0.5, 4.0));
+	}
+
+	// returns how many instructions inlining may add to one caller
+	int64_t get_growth_budget(int32_t opt_level) {
+		return 64 * opt_level;
+	}
+
+	class Inliner {
+		IRFunction &caller;
+		Set<std::string> variable_names;
+
+		public:
+
+		explicit Inliner(IRFunction &caller) : caller { caller } {
+			for (Variable *var : caller.get_parameter_vars()) {
+				this->variable_names.insert(var->get_name());
+			}
+			for (const Uptr<BasicBlock> &bb : caller.get_blocks()) {
+				for (const Uptr<Instruction> &inst : bb->get_inst()) {
+					if (InstructionDeclaration *decl = dynamic_cast<InstructionDeclaration *>(inst.get())) {
+						this->variable_names.insert((*decl->get_referent())->get_name());
+					}
+				}
+			}
+		}
+
+		// Replaces the call instruction at the given index of the block by
+		// the body of the callee. The instructions after the call move to
+		// a new block that the callee's returns branch to.
+		void inline_call(BasicBlock *bb, int index, IRFunction &callee) {
+			Vec<Uptr<BasicBlock>> &blocks = this->caller.get_blocks();
+			Vec<Uptr<Instruction>> &insts = bb->get_inst();
+			InstructionAssignment &call_inst = static_cast<InstructionAssignment &>(*insts[index]);
+			FunctionCall &call = static_cast<FunctionCall &>(*call_inst.get_source());
+			Opt<ItemRef<Variable> *> call_dest = call_inst.get_dest();
+
+			// every variable of the callee gets a fresh one in the caller
+			Map<Variable *, Variable *> variable_map;
+			Vec<Uptr<Instruction>> declarations;
+			auto add_variable = [&](Variable *var) {
+				Uptr<Variable> new_var = mkuptr<Variable>(
+					this->get_unused_variable_name(callee.get_name() + "_" + var->get_name()),
+					var->get_type()
+				);
+				variable_map.emplace(var, new_var.get());
+				declarations.push_back(mkuptr<InstructionDeclaration>(mv(new_var)));
+			};
+			for (Variable *var : callee.get_parameter_vars()) {
+				add_variable(var);
+			}
+			for (const Uptr<BasicBlock> &callee_bb : callee.get_blocks()) {
+				for (const Uptr<Instruction> &inst : callee_bb->get_inst()) {
+					if (InstructionDeclaration *decl = dynamic_cast<InstructionDeclaration *>(inst.get())) {
+						add_variable(*decl->get_referent());
+					}
+				}
+			}
+
+			// split the block after the call
+			Vec<Uptr<Instruction>> rest;
+			for (auto it = insts.begin() + index + 1; it != insts.end(); ++it) {
+				rest.push_back(mv(*it));
+			}
+			Uptr<BasicBlock> continuation = mkuptr<BasicBlock>(
+				cfg::get_unused_block_name(this->caller, bb->get_name() + "_after_" + callee.get_name()),
+				mv(rest),
+				mv(bb->get_terminator())
+			);
+			continuation->set_successors(continuation->get_terminator()->get_successor());
+			BasicBlock *continuation_ptr = continuation.get();
+			auto bb_it = std::find_if(blocks.begin(), blocks.end(), [&](const Uptr<BasicBlock> &block) {
+				return block.get() == bb;
+			});
+			blocks.insert(bb_it + 1, mv(continuation));
+
+			// copy the callee's blocks in between
+			Map<BasicBlock *, BasicBlock *> block_map;
+			Vec<BasicBlock *> new_blocks;
+			for (const Uptr<BasicBlock> &callee_bb : callee.get_blocks()) {
+				Vec<Uptr<Instruction>> new_insts;
+				for (const Uptr<Instruction> &inst : callee_bb->get_inst()) {
+					if (!dynamic_cast<InstructionDeclaration *>(inst.get())) {
+						new_insts.push_back(inst->clone());
+					}
+				}
+				Uptr<BasicBlock> new_bb = mkuptr<BasicBlock>(
+					cfg::get_unused_block_name(this->caller, callee.get_name() + "_" + callee_bb->get_name()),
+					mv(new_insts),
+					callee_bb->get_terminator()->clone()
+				);
+				block_map.emplace(callee_bb.get(), new_bb.get());
+				new_blocks.push_back(new_bb.get());
+				auto continuation_it = std::find_if(blocks.begin(), blocks.end(), [&](const Uptr<BasicBlock> &block) {
+					return block.get() == continuation_ptr;
+				});
+				blocks.insert(continuation_it, mv(new_bb));
+			}
+			for (BasicBlock *new_bb : new_blocks) {
+				for (Uptr<Instruction> &inst : new_bb->get_inst()) {
+					replace_variables(*inst, variable_map);
+				}
+				Uptr<Terminator> &te = new_bb->get_terminator();
+				replace_variables(*te, variable_map);
+				for (ItemRef<BasicBlock> *target : te->get_targets()) {
+					target->bind(block_map.at(*target->get_referent()));
+				}
+				if (TerminatorReturnVar *ret = dynamic_cast<TerminatorReturnVar *>(te.get())) {
+					if (call_dest) {
+						new_bb->get_inst().push_back(mkuptr<InstructionAssignment>(
+							mkuptr<ItemRef<Variable>>(**call_dest),
+							mv(*ret->get_operands()[0])
+						));
+					}
+					te = mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(continuation_ptr));
+				} else if (dynamic_cast<TerminatorReturnVoid *>(te.get())) {
+					te = mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(continuation_ptr));
+				}
+				new_bb->set_successors(te->get_successor());
+			}
+
+			// pass the arguments and jump into the copy
+			Vec<Uptr<Instruction>> argument_copies;
+			const Vec<Variable *> &parameters = callee.get_parameter_vars();
+			for (int i = 0; i < parameters.size(); ++i) {
+				argument_copies.push_back(mkuptr<InstructionAssignment>(
+					mkuptr<ItemRef<Variable>>(variable_map.at(parameters[i])),
+					call.get_arguments()[i]->clone()
+				));
+			}
+			insts.erase(insts.begin() + index, insts.end());
+			for (Uptr<Instruction> &inst : argument_copies) {
+				insts.push_back(mv(inst));
+			}
+			bb->set_terminator(mkuptr<TerminatorBranchOne>(
+				mkuptr<ItemRef<BasicBlock>>(block_map.at(callee.get_blocks()[0].get()))
+			));
+
+			Vec<Uptr<Instruction>> &entry_insts = blocks[0]->get_inst();
+			entry_insts.insert(
+				entry_insts.begin(),
+				std::make_move_iterator(declarations.begin()),
+				std::make_move_iterator(declarations.end())
+			);
+		}
+
+		private:
+
+		std::string get_unused_variable_name(const std::string &name_hint) {
+			std::string name = name_hint;
+			for (int counter = 0; this->variable_names.find(name) != this->variable_names.end(); ++counter) {
+				name = name_hint + std::to_string(counter);
+			}
+			this->variable_names.insert(name);
+			return name;
+		}
+	};
+
+	struct CallSite {
+		Instruction *inst;
+		IRFunction *callee;
+		double hotness;
+	};
+
+	bool inline_calls_in(IRFunction &caller, const call_graph::CallGraph &call_graph, int32_t opt_level, bool optimize_size) {
+		// find the call sites, hottest first
+		Vec<Uptr<BasicBlock>> &blocks = caller.get_blocks();
+		Vec<double> ranks = tracer::rank_blocks(blocks);
+		Vec<CallSite> call_sites;
+		for (int i = 0; i < blocks.size(); ++i) {
+			for (const Uptr<Instruction> &inst : blocks[i]->get_inst()) {
+				Opt<IRFunction *> callee = get_called_function(*inst);
+				if (!callee
+					|| *callee == &caller
+					|| call_graph.is_recursive(*callee)
+					|| (*get_call(*inst))->get_arguments().size() != (*callee)->get_parameter_vars().size())
+				{
+					continue;
+				}
+				call_sites.push_back({ inst.get(), *callee, ranks[i] * blocks.size() });
+			}
+		}
+		std::stable_sort(call_sites.begin(), call_sites.end(), [](const CallSite &a, const CallSite &b) {
+			return a.hotness > b.hotness;
+		});
+
+		Inliner inliner(caller);
+		int64_t budget = get_growth_budget(opt_level);
+		bool changed = false;
+		for (const CallSite &call_site : call_sites) {
+			int64_t size = get_function_size(*call_site.callee);
+			if (size > trivial_callee_size
+				&& (optimize_size || size > get_size_threshold(opt_level, call_site.hotness) || size > budget))
+			{
+				continue;
+			}
+			// earlier inlining may have moved the call to another block
+			for (const Uptr<BasicBlock> &bb : blocks) {
+				Vec<Uptr<Instruction>> &insts = bb->get_inst();
+				auto inst_it = std::find_if(insts.begin(), insts.end(), [&](const Uptr<Instruction> &inst) {
+					return inst.get() == call_site.inst;
+				});
+				if (inst_it != insts.end()) {
+					inliner.inline_call(bb.get(), inst_it - insts.begin(), *call_site.callee);
+					break;
+				}
+			}
+			budget -= size;
+			changed = true;
+		}
+		return changed;
+	}
+
+	bool inline_functions(Program &program, int32_t opt_level, bool optimize_size) {
+		call_graph::CallGraph call_graph(program);
+		bool changed = false;
+		for (IRFunction *ir_function : call_graph.get_bottom_up_order(program)) {
+			changed |= inline_calls_in(*ir_function, call_graph, opt_level, optimize_size);
+		}
+		return changed;
+	}
+}
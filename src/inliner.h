@@ -0,0 +1,17 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Function inlining. Calls to IR functions are replaced by a copy of
+	// the callee's body when a cost model deems it worth it: small callees
+	// are always inlined, bigger ones only at call sites the tracer ranks
+	// as hot, and never recursive ones. Each caller may only grow by a
+	// budget which is larger at higher optimization levels. When optimizing
+	// for size, only callees no bigger than a call are inlined. Returns
+	// whether anything was inlined.
+	bool inline_functions(Program &program, int32_t opt_level, bool optimize_size);
+}
@@ -0,0 +1,156 @@
+#include "inst_combine.h"
+#include "analysis.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// maps each variable to the operation that computed its current value,
+	// as long as the operands of that operation still hold the same values
+	using OperationMap = Map<Variable *, BinaryOperation *>;
+
+	// Returns the operator and right operand computing `(x inner_op
+	// inner_rhs) op rhs` straight from x, if there is one.
+	Opt<Pair<Operator, int64_t>> combine_constants(Operator inner_op, int64_t inner_rhs, Operator op, int64_t rhs) {
+		// a shift by a constant is a multiplication
+		if (inner_op == Operator::lshift) {
+			inner_op = Operator::times;
+			inner_rhs = evaluate_operator(Operator::lshift, 1, inner_rhs);
+		}
+		if (op == Operator::lshift && inner_op == Operator::times) {
+			op = Operator::times;
+			rhs = evaluate_operator(Operator::lshift, 1, rhs);
+		}
+		if (inner_op != op) {
+			return {};
+		}
+		switch (op) {
+			case Operator::plus:
+			case Operator::times:
+			case Operator::bitwise_and: return Pair<Operator, int64_t> { op, evaluate_operator(op, inner_rhs, rhs) };
+			default: return {};
+		}
+	}
+
+	Uptr<Expr> make_operation(const Uptr<Expr> &lhs, Operator op, int64_t rhs) {
+		return mkuptr<BinaryOperation>(lhs->clone(), mkuptr<NumberLiteral>(rhs), op);
+	}
+
+	// Returns a simpler expression computing the same value as the
+	// operation, if there is one.
+	Opt<Uptr<Expr>> simplify_operation(BinaryOperation &bin_op, const OperationMap &operations) {
+		Operator op = bin_op.get_operator();
+		Uptr<Expr> &lhs = bin_op.get_lhs();
+		Uptr<Expr> &rhs = bin_op.get_rhs();
+		Opt<int64_t> lhs_value = get_number(lhs);
+		Opt<int64_t> rhs_value = get_number(rhs);
+		if (lhs_value && rhs_value) {
+			return mkuptr<NumberLiteral>(evaluate_operator(op, *lhs_value, *rhs_value));
+		}
+		if (lhs_value) {
+			if (Opt<int64_t> result = evaluate_with_lhs(op, *lhs_value)) {
+				return mkuptr<NumberLiteral>(*result);
+			}
+			// keep the constant on the right
+			if (Opt<Operator> flipped = flip_operator(op)) {
+				return mkuptr<BinaryOperation>(rhs->clone(), lhs->clone(), *flipped);
+			}
+			return {};
+		}
+		Opt<Variable *> lhs_var = get_variable(lhs);
+		if (!rhs_value) {
+			if (!lhs_var || get_variable(rhs) != lhs_var) {
+				return {};
+			}
+			switch (op) {
+				case Operator::minus: return mkuptr<NumberLiteral>(0);
+				case Operator::lt:
+				case Operator::gt: return mkuptr<NumberLiteral>(0);
+				case Operator::le:
+				case Operator::eq:
+				case Operator::ge: return mkuptr<NumberLiteral>(1);
+				case Operator::bitwise_and: return lhs->clone();
+				default: return {};
+			}
+		}
+
+		if (Opt<int64_t> result = evaluate_with_rhs(op, *rhs_value)) {
+			return mkuptr<NumberLiteral>(*result);
+		}
+		if (is_right_identity(op, *rhs_value)) {
+			return lhs->clone();
+		}
+		// constants are added rather than subtracted, so they can combine
+		if (op == Operator::minus) {
+			return make_operation(lhs, Operator::plus, evaluate_operator(Operator::minus, 0, *rhs_value));
+		}
+		auto inner_it = lhs_var ? operations.find(*lhs_var) : operations.end();
+		if (inner_it != operations.end()) {
+			BinaryOperation &inner = *inner_it->second;
+			Operator inner_op = inner.get_operator();
+			if (is_comparison(inner_op)) {
+				// the result of a comparison is 0 or 1
+				if ((op == Operator::eq && *rhs_value == 1) || (op == Operator::bitwise_and && (*rhs_value & 1))) {
+					return lhs->clone();
+				}
+				if (op == Operator::eq && *rhs_value == 0) {
+					if (Opt<Operator> negated = negate_operator(inner_op)) {
+						return mkuptr<BinaryOperation>(inner.get_lhs()->clone(), inner.get_rhs()->clone(), *negated);
+					}
+				}
+			} else if (Opt<int64_t> inner_rhs = get_number(inner.get_rhs())) {
+				if (Opt<Pair<Operator, int64_t>> combined = combine_constants(inner_op, *inner_rhs, op, *rhs_value)) {
+					return make_operation(inner.get_lhs(), combined->first, combined->second);
+				}
+			}
+		}
+		if (Opt<Pair<Operator, int64_t>> reduced = reduce_strength(op, *rhs_value)) {
+			return make_operation(lhs, reduced->first, reduced->second);
+		}
+		return {};
+	}
+
+	// forgets the operations that no longer compute the value of their
+	// variable once var is written to
+	void forget_operations(Variable *var, OperationMap &operations) {
+		operations.erase(var);
+		for (auto it = operations.begin(); it != operations.end();) {
+			BinaryOperation &bin_op = *it->second;
+			if (get_variable(bin_op.get_lhs()) == var || get_variable(bin_op.get_rhs()) == var) {
+				it = operations.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	bool combine_instructions(IRFunction &ir_function) {
+		bool changed = false;
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			OperationMap operations;
+			for (Uptr<Instruction> &inst : bb->get_inst()) {
+				InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(inst.get());
+				if (assignment) {
+					Uptr<Expr> &source = assignment->get_source();
+					while (BinaryOperation *bin_op = dynamic_cast<BinaryOperation *>(source.get())) {
+						Opt<Uptr<Expr>> simplified = simplify_operation(*bin_op, operations);
+						if (!simplified) {
+							break;
+						}
+						source = mv(*simplified);
+						changed = true;
+					}
+				}
+				Opt<Variable *> def = get_def(*inst);
+				if (!def) {
+					continue;
+				}
+				forget_operations(*def, operations);
+				BinaryOperation *bin_op = assignment ? dynamic_cast<BinaryOperation *>(assignment->get_source().get()) : nullptr;
+				if (bin_op && get_variable(bin_op->get_lhs()) != def && get_variable(bin_op->get_rhs()) != def) {
+					operations.emplace(*def, bin_op);
+				}
+			}
+		}
+		return changed;
+	}
+}
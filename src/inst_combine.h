@@ -0,0 +1,17 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Instruction combining. Applies algebraic identities to operations
+	// (`x + 0`, `x * 0`, `x - x`, `x < x`, ...), folds the constant terms of
+	// chains like `(x + 1) + 2` or `(x * 3) << 2` into a single operation,
+	// turns multiplications by a power of two into shifts, and turns a
+	// comparison whose result is compared to 0 back into a comparison. Only
+	// chains within a block are combined. Returns whether the function was
+	// changed.
+	bool combine_instructions(IRFunction &ir_function);
+}
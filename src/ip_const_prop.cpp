@@ -0,0 +1,417 @@
+#include "ip_const_prop.h"
+#include "analysis.h"
+#include "call_graph.h"
+#include "cfg.h"
+#include "const_prop.h"
+#include "tracer.h"
+#include <algorithm>
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// call sites ranked colder than an average block of the caller are not
+	// worth a copy of the callee
+	const double min_specialization_hotness = 1.0;
+
+	// returns how many instructions the specialized copies may add up to
+	int64_t get_specialization_budget(int32_t opt_level) {
+		return 32 * opt_level;
+	}
+
+	// What the call sites pass for a parameter: nothing until the first
+	// call site is seen, then its constant until a call site disagrees.
+	class ArgumentValue {
+		bool seen;
+		bool varies;
+		int64_t constant;
+
+		public:
+
+		ArgumentValue() : seen { false }, varies { false }, constant { 0 } {}
+
+		void meet(Opt<int64_t> value) {
+			if (!value || (this->seen && *value != this->constant)) {
+				this->varies = true;
+			} else {
+				this->constant = *value;
+			}
+			this->seen = true;
+		}
+
+		Opt<int64_t> get_constant() const {
+			if (!this->seen || this->varies) {
+				return {};
+			}
+			return this->constant;
+		}
+	};
+
+	// returns the variables some instruction of the function writes to
+	Set<Variable *> get_assigned_variables(IRFunction &ir_function) {
+		Set<Variable *> result;
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				if (Opt<Variable *> def = get_def(*inst)) {
+					result.insert(*def);
+				}
+			}
+		}
+		return result;
+	}
+
+	// returns the variables some instruction or terminator of the function
+	// reads
+	Set<Variable *> get_used_variables(IRFunction &ir_function) {
+		Set<Variable *> result;
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				for (Variable *var : get_uses(*inst)) {
+					result.insert(var);
+				}
+			}
+			for (Variable *var : get_uses(*bb->get_terminator())) {
+				result.insert(var);
+			}
+		}
+		return result;
+	}
+
+	// Meets what every direct call site passes into the parameters of its
+	// callee. A recursive call passing on a parameter that is never
+	// reassigned passes whatever the other call sites do, so it's ignored.
+	Map<IRFunction *, Vec<ArgumentValue>> find_argument_values(Program &program) {
+		Map<IRFunction *, Vec<ArgumentValue>> result;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			result[ir_function.get()].resize(ir_function->get_parameter_vars().size());
+		}
+		for (const Uptr<IRFunction> &caller : program.get_ir_functions()) {
+			Set<Variable *> assigned = get_assigned_variables(*caller);
+			for (const Uptr<BasicBlock> &bb : caller->get_blocks()) {
+				for (const Uptr<Instruction> &inst : bb->get_inst()) {
+					Opt<IRFunction *> callee = get_called_function(*inst);
+					if (!callee) {
+						continue;
+					}
+					Vec<ArgumentValue> &values = result.at(*callee);
+					Vec<Uptr<Expr>> &arguments = (*get_call(*inst))->get_arguments();
+					const Vec<Variable *> &parameters = (*callee)->get_parameter_vars();
+					for (int i = 0; i < parameters.size(); ++i) {
+						if (arguments.size() != parameters.size()) {
+							values[i].meet({});
+							continue;
+						}
+						Opt<Variable *> var = get_variable(arguments[i]);
+						if (*callee == caller.get() && var == parameters[i] && !assigned.count(parameters[i])) {
+							continue;
+						}
+						values[i].meet(get_number(arguments[i]));
+					}
+				}
+			}
+		}
+		return result;
+	}
+
+	// Turns the given parameters of the function into local variables that
+	// are set to the given constants on entry, and stops the given call
+	// sites from passing them. The entry block gets a new block in front if
+	// it can be branched back to.
+	void fix_parameters(
+		IRFunction &ir_function,
+		const Map<int, int64_t> &constants,
+		const Vec<FunctionCall *> &calls
+	) {
+		BasicBlock *entry_block = ir_function.get_blocks()[0].get();
+		Map<BasicBlock *, Vec<BasicBlock *>> predecessors = cfg::get_predecessors(ir_function);
+		if (!predecessors.at(entry_block).empty()) {
+			entry_block = cfg::insert_block_before(ir_function, entry_block, entry_block->get_name() + "_params");
+		}
+		Vec<Uptr<Instruction>> new_insts;
+		Vec<Uptr<Instruction>> assignments;
+		// go backwards so the indices of the remaining parameters stay valid
+		for (auto it = constants.rbegin(); it != constants.rend(); ++it) {
+			const auto &[index, value] = *it;
+			Uptr<Variable> var = ir_function.remove_parameter(index);
+			assignments.push_back(mkuptr<InstructionAssignment>(
+				mkuptr<ItemRef<Variable>>(var.get()),
+				mkuptr<NumberLiteral>(value)
+			));
+			new_insts.push_back(mkuptr<InstructionDeclaration>(mv(var)));
+			for (FunctionCall *call : calls) {
+				Vec<Uptr<Expr>> &arguments = call->get_arguments();
+				arguments.erase(arguments.begin() + index);
+			}
+		}
+		for (Uptr<Instruction> &inst : assignments) {
+			new_insts.push_back(mv(inst));
+		}
+		Vec<Uptr<Instruction>> &insts = entry_block->get_inst();
+		insts.insert(insts.begin(), std::make_move_iterator(new_insts.begin()), std::make_move_iterator(new_insts.end()));
+	}
+
+	// returns the calls to each IR function made by name
+	Map<IRFunction *, Vec<FunctionCall *>> find_direct_calls(Program &program) {
+		Map<IRFunction *, Vec<FunctionCall *>> result;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			for (const Uptr<BasicBlock> &bb : ir_function->get_blocks()) {
+				for (const Uptr<Instruction> &inst : bb->get_inst()) {
+					if (Opt<IRFunction *> callee = get_called_function(*inst)) {
+						result[*callee].push_back(*get_call(*inst));
+					}
+				}
+			}
+		}
+		return result;
+	}
+
+	// Replaces the parameters which every call site passes the same
+	// constant. @main and functions that may be called through a variable
+	// keep theirs. Returns whether any was replaced.
+	bool propagate_arguments(Program &program) {
+		call_graph::CallGraph call_graph(program);
+		const Set<IRFunction *> &address_taken = call_graph.get_address_taken();
+		Map<IRFunction *, Vec<ArgumentValue>> argument_values = find_argument_values(program);
+		Map<IRFunction *, Vec<FunctionCall *>> calls = find_direct_calls(program);
+		bool changed = false;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			if (ir_function->get_name() == "main" || address_taken.count(ir_function.get())) {
+				continue;
+			}
+			Map<int, int64_t> constants;
+			const Vec<ArgumentValue> &values = argument_values.at(ir_function.get());
+			for (int i = 0; i < values.size(); ++i) {
+				if (Opt<int64_t> constant = values[i].get_constant()) {
+					constants.emplace(i, *constant);
+				}
+			}
+			if (constants.empty()) {
+				continue;
+			}
+			fix_parameters(*ir_function, constants, calls[ir_function.get()]);
+			changed = true;
+		}
+		return changed;
+	}
+
+	// returns the constant a function always returns, if any
+	Opt<int64_t> get_returned_constant(IRFunction &ir_function) {
+		Opt<int64_t> result;
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			Terminator *te = bb->get_terminator().get();
+			if (dynamic_cast<TerminatorReturnVoid *>(te)) {
+				return {};
+			}
+			if (dynamic_cast<TerminatorReturnVar *>(te)) {
+				Opt<int64_t> value = get_number(*te->get_operands()[0]);
+				if (!value || (result && *result != *value)) {
+					return {};
+				}
+				result = value;
+			}
+		}
+		return result;
+	}
+
+	// Splits every call to a function that always returns the same
+	// constant into the call, which no longer writes anything, and an
+	// assignment of the constant. Returns whether any call was split.
+	bool propagate_return_values(Program &program) {
+		Map<IRFunction *, Opt<int64_t>> returned_constants;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			returned_constants.emplace(ir_function.get(), get_returned_constant(*ir_function));
+		}
+		bool changed = false;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			for (const Uptr<BasicBlock> &bb : ir_function->get_blocks()) {
+				Vec<Uptr<Instruction>> &insts = bb->get_inst();
+				for (int i = 0; i < insts.size(); ++i) {
+					Opt<IRFunction *> callee = get_called_function(*insts[i]);
+					Opt<Variable *> dest = get_def(*insts[i]);
+					if (!callee || !dest || !returned_constants.at(*callee)) {
+						continue;
+					}
+					Uptr<Expr> &source = static_cast<InstructionAssignment &>(*insts[i]).get_source();
+					static_cast<FunctionCall &>(*source).set_tail_call(false);
+					insts[i] = mkuptr<InstructionAssignment>(mv(source));
+					insts.insert(insts.begin() + i + 1, mkuptr<InstructionAssignment>(
+						mkuptr<ItemRef<Variable>>(*dest),
+						mkuptr<NumberLiteral>(*returned_constants.at(*callee))
+					));
+					changed = true;
+				}
+			}
+		}
+		return changed;
+	}
+
+	// Returns a copy of the function under a new name, with variables and
+	// blocks of its own.
+	Uptr<IRFunction> clone_function(IRFunction &ir_function, std::string name) {
+		Map<Variable *, Variable *> variable_map;
+		Vec<Uptr<Variable>> vars;
+		Vec<Variable *> parameter_vars;
+		for (Variable *param : ir_function.get_parameter_vars()) {
+			Uptr<Variable> new_param = mkuptr<Variable>(param->get_name(), param->get_type());
+			variable_map.emplace(param, new_param.get());
+			parameter_vars.push_back(new_param.get());
+			vars.push_back(mv(new_param));
+		}
+		Map<BasicBlock *, BasicBlock *> block_map;
+		Vec<Uptr<BasicBlock>> blocks;
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			Vec<Uptr<Instruction>> new_insts;
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				Uptr<Instruction> new_inst = inst->clone();
+				if (InstructionDeclaration *decl = dynamic_cast<InstructionDeclaration *>(inst.get())) {
+					InstructionDeclaration &new_decl = static_cast<InstructionDeclaration &>(*new_inst);
+					variable_map.emplace(*decl->get_referent(), *new_decl.get_referent());
+				}
+				new_insts.push_back(mv(new_inst));
+			}
+			blocks.push_back(mkuptr<BasicBlock>(bb->get_name(), mv(new_insts), bb->get_terminator()->clone()));
+			block_map.emplace(bb.get(), blocks.back().get());
+		}
+		for (const Uptr<BasicBlock> &bb : blocks) {
+			for (Uptr<Instruction> &inst : bb->get_inst()) {
+				replace_variables(*inst, variable_map);
+			}
+			Uptr<Terminator> &te = bb->get_terminator();
+			replace_variables(*te, variable_map);
+			for (ItemRef<BasicBlock> *target : te->get_targets()) {
+				target->bind(block_map.at(*target->get_referent()));
+			}
+			bb->set_successors(te->get_successor());
+		}
+		return mkuptr<IRFunction>(
+			mv(name),
+			ir_function.get_ret_type(),
+			mv(blocks),
+			mv(vars),
+			mv(parameter_vars),
+			AggregateScope {}
+		);
+	}
+
+	struct SpecializationSite {
+		FunctionCall *call;
+		IRFunction *callee;
+		// the constant passed for each parameter worth specializing on
+		Map<int, int64_t> constants;
+		double hotness;
+	};
+
+	// Finds the call sites passing constants into parameters that their
+	// callee reads, hottest first.
+	Vec<SpecializationSite> find_specialization_sites(Program &program) {
+		Map<IRFunction *, Set<Variable *>> used_variables;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			used_variables.emplace(ir_function.get(), get_used_variables(*ir_function));
+		}
+		Vec<SpecializationSite> result;
+		for (const Uptr<IRFunction> &caller : program.get_ir_functions()) {
+			Vec<Uptr<BasicBlock>> &blocks = caller->get_blocks();
+			Vec<double> ranks = tracer::rank_blocks(blocks);
+			for (int i = 0; i < blocks.size(); ++i) {
+				double hotness = ranks[i] * blocks.size();
+				if (hotness < min_specialization_hotness) {
+					continue;
+				}
+				for (const Uptr<Instruction> &inst : blocks[i]->get_inst()) {
+					Opt<IRFunction *> callee = get_called_function(*inst);
+					if (!callee || *callee == caller.get() || (*callee)->get_name() == "main") {
+						continue;
+					}
+					FunctionCall *call = *get_call(*inst);
+					const Vec<Variable *> &parameters = (*callee)->get_parameter_vars();
+					if (call->get_arguments().size() != parameters.size()) {
+						continue;
+					}
+					Map<int, int64_t> constants;
+					for (int j = 0; j < parameters.size(); ++j) {
+						Opt<int64_t> value = get_number(call->get_arguments()[j]);
+						if (value && used_variables.at(*callee).count(parameters[j])) {
+							constants.emplace(j, *value);
+						}
+					}
+					if (!constants.empty()) {
+						result.push_back({ call, *callee, mv(constants), hotness });
+					}
+				}
+			}
+		}
+		std::stable_sort(result.begin(), result.end(), [](const SpecializationSite &a, const SpecializationSite &b) {
+			return a.hotness > b.hotness;
+		});
+		return result;
+	}
+
+	// returns a name for a new function which no function in the program has
+	std::string get_unused_function_name(Program &program, const std::string &name_hint) {
+		Set<std::string> names;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			names.insert(ir_function->get_name());
+		}
+		std::string name;
+		for (int counter = 1; name.empty() || names.count(name); ++counter) {
+			name = name_hint + std::to_string(counter);
+		}
+		return name;
+	}
+
+	// Points the hottest call sites passing constants at copies of their
+	// callees with those constants fixed. Call sites passing the same
+	// constants to the same callee share a copy. Returns whether any call
+	// site was changed.
+	bool specialize_functions(Program &program, int32_t opt_level) {
+		int64_t budget = get_specialization_budget(opt_level);
+		Map<Pair<IRFunction *, Map<int, int64_t>>, IRFunction *> specializations;
+		bool changed = false;
+		for (SpecializationSite &site : find_specialization_sites(program)) {
+			auto key = std::make_pair(site.callee, site.constants);
+			auto specialization_it = specializations.find(key);
+			if (specialization_it == specializations.end()) {
+				int64_t size = get_function_size(*site.callee);
+				if (size > budget) {
+					continue;
+				}
+				budget -= size;
+				std::string name = get_unused_function_name(program, site.callee->get_name() + "_spec");
+				program.get_ir_functions().push_back(clone_function(*site.callee, mv(name)));
+				IRFunction *specialization = program.get_ir_functions().back().get();
+				fix_parameters(*specialization, site.constants, {});
+				specialization_it = specializations.emplace(key, specialization).first;
+			}
+			Vec<Uptr<Expr>> &arguments = site.call->get_arguments();
+			for (auto it = site.constants.rbegin(); it != site.constants.rend(); ++it) {
+				arguments.erase(arguments.begin() + it->first);
+			}
+			static_cast<ItemRef<IRFunction> &>(*site.call->get_callee()).bind(specialization_it->second);
+			changed = true;
+		}
+		return changed;
+	}
+
+	bool propagate_constants_across_calls(Program &program, int32_t opt_level, bool optimize_size) {
+		// constants folded into one function can become arguments to the
+		// next, so keep going until no more are found
+		bool changed = false;
+		bool progress = true;
+		while (progress) {
+			progress = propagate_arguments(program);
+			progress |= propagate_return_values(program);
+			if (progress) {
+				for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+					propagate_constants(*ir_function);
+				}
+			}
+			changed |= progress;
+		}
+		if (!optimize_size && specialize_functions(program, opt_level)) {
+			for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+				propagate_constants(*ir_function);
+			}
+			changed = true;
+		}
+		return changed;
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Interprocedural constant propagation. A parameter which every call
+	// site passes the same constant is set to that constant on entry, and
+	// a function which always returns the same constant has it copied into
+	// the result of every call; constant propagation then folds them
+	// through each function, possibly exposing more constant arguments.
+	// Functions whose address is taken keep their parameters. Where the
+	// call sites disagree, the hottest ones passing constants call a
+	// specialized copy of the callee (`@f_spec1`) instead, as long as the
+	// copies fit in a code size budget. Nothing is specialized when
+	// optimizing for size. Returns whether the program was changed.
+	bool propagate_constants_across_calls(Program &program, int32_t opt_level, bool optimize_size);
+}
@@ -0,0 +1,300 @@
+#include "licm.h"
+#include "analysis.h"
+#include "cfg.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// what the instructions of a loop do
+	struct LoopEffects {
+		Map<Variable *, int> def_counts;
+		// the memory alias classes stored to; see get_memory_class
+		Set<Variable *> stored_memory;
+		// whether a call may write to memory
+		bool has_writing_call;
+	};
+
+	// non-escaping arrays have their own memory, which nothing else can
+	// write to. every other array is in the class keyed by nullptr
+	Variable *get_memory_class(Variable *array, const Set<Variable *> &local_arrays) {
+		return local_arrays.find(array) != local_arrays.end() ? array : nullptr;
+	}
+
+	LoopEffects find_loop_effects(
+		IRFunction &ir_function,
+		const cfg::Loop &loop,
+		const Set<Variable *> &local_arrays,
+		const call_graph::SummaryMap &summaries
+	) {
+		LoopEffects effects { {}, {}, false };
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			if (!loop.contains(block.get())) {
+				continue;
+			}
+			for (const Uptr<Instruction> &inst : block->get_inst()) {
+				if (Opt<Variable *> def = get_def(*inst)) {
+					effects.def_counts[*def] += 1;
+				}
+				if (dynamic_cast<InstructionStore *>(inst.get())) {
+					Variable *array = *(*inst->get_accessed_array())->get_referent();
+					effects.stored_memory.insert(get_memory_class(array, local_arrays));
+				} else if (InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(inst.get())) {
+					FunctionCall *call = dynamic_cast<FunctionCall *>(assignment->get_source().get());
+					if (call && call_graph::get_call_summary(*call, summaries).writes_memory) {
+						effects.has_writing_call = true;
+					}
+				}
+			}
+		}
+		return effects;
+	}
+
+	bool is_pure_computation(Instruction &inst) {
+		InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(&inst);
+		return assignment
+			&& get_def(inst)
+			&& !dynamic_cast<FunctionCall *>(assignment->get_source().get());
+	}
+
+	class LoopMotion {
+		IRFunction &ir_function;
+		const cfg::DominatorTree &dominators;
+		const cfg::Loop &loop;
+		const Set<Variable *> &local_arrays;
+		const call_graph::SummaryMap &summaries;
+		BasicBlock *preheader;
+
+		public:
+
+		LoopMotion(
+			IRFunction &ir_function,
+			const cfg::DominatorTree &dominators,
+			const cfg::Loop &loop,
+			const Set<Variable *> &local_arrays,
+			const call_graph::SummaryMap &summaries,
+			BasicBlock *preheader
+		) :
+			ir_function { ir_function },
+			dominators { dominators },
+			loop { loop },
+			local_arrays { local_arrays },
+			summaries { summaries },
+			preheader { preheader }
+		{}
+
+		bool hoist() {
+			Liveness liveness = compute_liveness(this->ir_function);
+			Set<BasicBlock *> exiting_blocks = this->loop.get_exiting_blocks();
+			Set<BasicBlock *> exit_blocks = this->loop.get_exit_blocks();
+
+			// hoisting an instruction can make the ones using it invariant,
+			// so keep going until nothing changes
+			bool changed = false;
+			bool progress = true;
+			while (progress) {
+				progress = false;
+				LoopEffects effects = find_loop_effects(this->ir_function, this->loop, this->local_arrays, this->summaries);
+				for (const Uptr<BasicBlock> &block : this->ir_function.get_blocks()) {
+					if (!this->loop.contains(block.get())) {
+						continue;
+					}
+					bool dominates_exits = true;
+					for (BasicBlock *exiting_block : exiting_blocks) {
+						dominates_exits &= this->dominators.dominates(block.get(), exiting_block);
+					}
+					Vec<Uptr<Instruction>> &insts = block->get_inst();
+					for (auto it = insts.begin(); it != insts.end();) {
+						if (!this->can_hoist(**it, effects, liveness, exit_blocks, dominates_exits)) {
+							++it;
+							continue;
+						}
+						effects.def_counts[*get_def(**it)] = 0;
+						this->preheader->get_inst().push_back(mv(*it));
+						it = insts.erase(it);
+						progress = true;
+						changed = true;
+					}
+				}
+			}
+			return changed;
+		}
+
+		bool sink() {
+			Set<BasicBlock *> exit_blocks = this->loop.get_exit_blocks();
+			if (exit_blocks.size() != 1) {
+				return false;
+			}
+			BasicBlock *exit_block = *exit_blocks.begin();
+			Map<BasicBlock *, Vec<BasicBlock *>> predecessors = cfg::get_predecessors(this->ir_function);
+			for (BasicBlock *pred : predecessors.at(exit_block)) {
+				if (!this->loop.contains(pred)) {
+					return false;
+				}
+			}
+
+			bool changed = false;
+			Liveness liveness = compute_liveness(this->ir_function);
+			LoopEffects effects = find_loop_effects(this->ir_function, this->loop, this->local_arrays, this->summaries);
+			Set<Variable *> loop_uses = this->find_loop_uses();
+			for (const Uptr<BasicBlock> &block : this->ir_function.get_blocks()) {
+				if (!this->loop.contains(block.get())) {
+					continue;
+				}
+				Vec<Uptr<Instruction>> &insts = block->get_inst();
+				// go backwards so that an instruction used by one sunk after
+				// it is sunk too, and lands before it
+				for (int i = insts.size() - 1; i >= 0; --i) {
+					if (!is_pure_computation(*insts[i])) {
+						continue;
+					}
+					Variable *dest = *get_def(*insts[i]);
+					if (effects.def_counts.at(dest) != 1
+						|| loop_uses.find(dest) != loop_uses.end()
+						|| liveness.live_in.at(this->loop.header).count(dest)
+						|| !liveness.live_in.at(exit_block).count(dest)
+						|| !this->operands_reach_exit(*block, i))
+					{
+						continue;
+					}
+					Vec<Uptr<Instruction>> &exit_insts = exit_block->get_inst();
+					exit_insts.insert(exit_insts.begin(), mv(insts[i]));
+					insts.erase(insts.begin() + i);
+					liveness = compute_liveness(this->ir_function);
+					loop_uses = this->find_loop_uses();
+					changed = true;
+				}
+			}
+			return changed;
+		}
+
+		private:
+
+		bool can_hoist(
+			Instruction &inst,
+			const LoopEffects &effects,
+			const Liveness &liveness,
+			const Set<BasicBlock *> &exit_blocks,
+			bool dominates_exits
+		) {
+			// loads and lengths may not be safe to execute on paths where
+			// they weren't, so they must run every time the loop is entered
+			bool reads_memory = false;
+			if (InstructionLoad *load = dynamic_cast<InstructionLoad *>(&inst)) {
+				Variable *array = *load->get_location().get_base().get_referent();
+				Variable *memory_class = get_memory_class(array, this->local_arrays);
+				if (effects.stored_memory.find(memory_class) != effects.stored_memory.end()
+					|| (!memory_class && effects.has_writing_call))
+				{
+					return false;
+				}
+				reads_memory = true;
+			} else if (dynamic_cast<InstructionLength *>(&inst)) {
+				reads_memory = true;
+			} else if (!is_pure_computation(inst)) {
+				return false;
+			}
+			if (reads_memory && !dominates_exits) {
+				return false;
+			}
+
+			for (Variable *var : get_uses(inst)) {
+				auto count_it = effects.def_counts.find(var);
+				if (count_it != effects.def_counts.end() && count_it->second > 0) {
+					return false;
+				}
+			}
+
+			// the destination must only get its value from this instruction
+			// while in the loop, and must have the same value after the loop
+			Variable *dest = *get_def(inst);
+			if (effects.def_counts.at(dest) != 1 || liveness.live_in.at(this->loop.header).count(dest)) {
+				return false;
+			}
+			if (!dominates_exits) {
+				for (BasicBlock *exit_block : exit_blocks) {
+					if (liveness.live_in.at(exit_block).count(dest)) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		Set<Variable *> find_loop_uses() {
+			Set<Variable *> result;
+			for (BasicBlock *block : this->loop.blocks) {
+				for (const Uptr<Instruction> &inst : block->get_inst()) {
+					for (Variable *var : get_uses(*inst)) {
+						result.insert(var);
+					}
+				}
+				for (Variable *var : get_uses(*block->get_terminator())) {
+					result.insert(var);
+				}
+			}
+			return result;
+		}
+
+		// Returns whether the operands of the instruction at the given index
+		// of the block keep their values from that instruction until the
+		// loop is left
+		bool operands_reach_exit(BasicBlock &block, int index) {
+			Vec<Variable *> operands = get_uses(*block.get_inst()[index]);
+			auto defines_operand = [&](Instruction &inst) {
+				Opt<Variable *> def = get_def(inst);
+				return def && std::find(operands.begin(), operands.end(), *def) != operands.end();
+			};
+			for (int i = index + 1; i < block.get_inst().size(); ++i) {
+				if (defines_operand(*block.get_inst()[i])) {
+					return false;
+				}
+			}
+			// entering the block again recomputes the instruction, so only
+			// look at the blocks in between
+			Set<BasicBlock *> visited = { &block };
+			Vec<BasicBlock *> stack;
+			for (const auto &[succ, weight] : block.get_successors()) {
+				stack.push_back(succ);
+			}
+			while (!stack.empty()) {
+				BasicBlock *region_block = stack.back();
+				stack.pop_back();
+				if (!this->loop.contains(region_block) || !visited.insert(region_block).second) {
+					continue;
+				}
+				for (const Uptr<Instruction> &inst : region_block->get_inst()) {
+					if (defines_operand(*inst)) {
+						return false;
+					}
+				}
+				for (const auto &[succ, weight] : region_block->get_successors()) {
+					stack.push_back(succ);
+				}
+			}
+			return true;
+		}
+	};
+
+	bool move_loop_invariant_code(IRFunction &ir_function, const call_graph::SummaryMap &summaries) {
+		// give every loop a preheader first, since that changes the CFG
+		bool changed = false;
+		{
+			cfg::DominatorTree dominators = cfg::make_dominator_tree(ir_function);
+			for (const cfg::Loop &loop : cfg::find_loops(ir_function, dominators)) {
+				size_t num_blocks = ir_function.get_blocks().size();
+				cfg::get_or_create_preheader(ir_function, loop);
+				changed |= ir_function.get_blocks().size() != num_blocks;
+			}
+		}
+
+		cfg::DominatorTree dominators = cfg::make_dominator_tree(ir_function);
+		Set<Variable *> local_arrays = get_non_escaping_arrays(ir_function);
+		for (const cfg::Loop &loop : cfg::find_loops(ir_function, dominators)) {
+			BasicBlock *preheader = cfg::get_or_create_preheader(ir_function, loop);
+			LoopMotion motion(ir_function, dominators, loop, local_arrays, summaries, preheader);
+			changed |= motion.hoist();
+			changed |= motion.sink();
+		}
+		return changed;
+	}
+}
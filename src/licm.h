@@ -0,0 +1,17 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+#include "call_graph.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Loop-invariant code motion. Pure instructions whose operands don't
+	// change inside a loop are hoisted into the loop's preheader (which is
+	// created if needed), as are loads from memory that nothing in the loop
+	// (including the calls it makes) can write to. Pure instructions whose
+	// result is only used after the loop are sunk into the loop's exit.
+	// Returns whether the function was changed.
+	bool move_loop_invariant_code(IRFunction &ir_function, const call_graph::SummaryMap &summaries);
+}
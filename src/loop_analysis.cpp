@@ -0,0 +1,346 @@
+#include "loop_analysis.h"
+#include "analysis.h"
+#include <limits>
+
+namespace IR::analysis {
+	Vec<Pair<BasicBlock *, int>> find_loop_defs(const cfg::Loop &loop, Variable *var) {
+		Vec<Pair<BasicBlock *, int>> defs;
+		for (BasicBlock *bb : loop.blocks) {
+			Vec<Uptr<Instruction>> &insts = bb->get_inst();
+			for (int i = 0; i < insts.size(); ++i) {
+				if (get_def(*insts[i]) == var) {
+					defs.emplace_back(bb, i);
+				}
+			}
+		}
+		return defs;
+	}
+
+	// returns c if the instruction computes `var + c`
+	Opt<int64_t> get_increment(Instruction &inst, Variable *var) {
+		InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(&inst);
+		BinaryOperation *bin_op = assignment ? dynamic_cast<BinaryOperation *>(assignment->get_source().get()) : nullptr;
+		if (!bin_op || get_variable(bin_op->get_lhs()) != var) {
+			return {};
+		}
+		Opt<int64_t> rhs = get_number(bin_op->get_rhs());
+		if (!rhs) {
+			return {};
+		}
+		switch (bin_op->get_operator()) {
+			case Operator::plus: return *rhs;
+			case Operator::minus: return evaluate_operator(Operator::minus, 0, *rhs);
+			default: return {};
+		}
+	}
+
+	// Returns how much var grows by in each iteration, if it is written
+	// exactly once per iteration, with its own value plus a constant. The
+	// sum may go through another variable first (`j <- i + 1`, `i <- j`).
+	Opt<int64_t> find_step(const cfg::Loop &loop, const cfg::DominatorTree &dominators, Variable *var) {
+		Vec<Pair<BasicBlock *, int>> defs = find_loop_defs(loop, var);
+		if (defs.size() != 1) {
+			return {};
+		}
+		auto [bb, index] = defs[0];
+		if (bb == loop.header) {
+			return {};
+		}
+		for (BasicBlock *latch : loop.latches) {
+			if (!dominators.dominates(bb, latch)) {
+				return {};
+			}
+		}
+		Instruction &inst = *bb->get_inst()[index];
+		if (Opt<int64_t> step = get_increment(inst, var)) {
+			return step;
+		}
+		InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(&inst);
+		Opt<Variable *> source = assignment ? get_variable(assignment->get_source()) : Opt<Variable *> {};
+		if (!source) {
+			return {};
+		}
+		Vec<Pair<BasicBlock *, int>> source_defs = find_loop_defs(loop, *source);
+		if (source_defs.size() != 1) {
+			return {};
+		}
+		auto [source_bb, source_index] = source_defs[0];
+		bool comes_first = source_bb == bb
+			? source_index < index
+			: dominators.dominates(source_bb, bb);
+		if (!comes_first) {
+			return {};
+		}
+		return get_increment(*source_bb->get_inst()[source_index], var);
+	}
+
+	Opt<CountedLoop> analyze_counted_loop(const cfg::Loop &loop, const cfg::DominatorTree &dominators) {
+		if (loop.get_exiting_blocks() != Set<BasicBlock *> { loop.header }) {
+			return {};
+		}
+		TerminatorBranchTwo *branch = dynamic_cast<TerminatorBranchTwo *>(loop.header->get_terminator().get());
+		if (!branch) {
+			return {};
+		}
+		Opt<Variable *> condition = get_variable(*branch->get_operands()[0]);
+		BasicBlock *true_target = *branch->get_branch_true().get_referent();
+		BasicBlock *false_target = *branch->get_branch_false().get_referent();
+		if (!condition || loop.contains(true_target) == loop.contains(false_target)) {
+			return {};
+		}
+
+		// find the comparison the branch tests, which must still see the
+		// values it compared
+		Vec<Uptr<Instruction>> &insts = loop.header->get_inst();
+		BinaryOperation *comparison = nullptr;
+		Set<Variable *> defined_after;
+		for (auto it = insts.rbegin(); it != insts.rend(); ++it) {
+			Opt<Variable *> def = get_def(**it);
+			if (def == condition) {
+				InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(it->get());
+				comparison = assignment ? dynamic_cast<BinaryOperation *>(assignment->get_source().get()) : nullptr;
+				break;
+			}
+			if (def) {
+				defined_after.insert(*def);
+			}
+		}
+		if (!comparison) {
+			return {};
+		}
+		Opt<Operator> op = comparison->get_operator();
+		if (!loop.contains(true_target)) {
+			op = negate_operator(*op);
+		}
+		if (!op) {
+			return {};
+		}
+
+		// one side is the induction variable and the other doesn't change
+		auto is_invariant = [&](const Uptr<Expr> &expr) {
+			Opt<Variable *> var = get_variable(expr);
+			return get_number(expr) || (var && find_loop_defs(loop, *var).empty());
+		};
+		const Uptr<Expr> *induction_expr = &comparison->get_lhs();
+		const Uptr<Expr> *bound = &comparison->get_rhs();
+		if (is_invariant(*induction_expr)) {
+			std::swap(induction_expr, bound);
+			op = flip_operator(*op);
+		}
+		Opt<Variable *> induction_var = get_variable(*induction_expr);
+		if (!induction_var || !is_invariant(*bound) || defined_after.count(*induction_var)) {
+			return {};
+		}
+		Opt<int64_t> step = find_step(loop, dominators, *induction_var);
+		if (!step) {
+			return {};
+		}
+		bool counts_up = *op == Operator::lt || *op == Operator::le;
+		bool counts_down = *op == Operator::gt || *op == Operator::ge;
+		if (!(counts_up && *step > 0) && !(counts_down && *step < 0)) {
+			return {};
+		}
+		return CountedLoop {
+			*induction_var,
+			*step,
+			*op,
+			(*bound)->clone(),
+			loop.contains(true_target) ? true_target : false_target,
+			loop.contains(true_target) ? false_target : true_target
+		};
+	}
+
+	Opt<int64_t> find_initial_value(IRFunction &ir_function, const cfg::Loop &loop, Variable *var) {
+		Map<BasicBlock *, Vec<BasicBlock *>> predecessors = cfg::get_predecessors(ir_function);
+		Vec<BasicBlock *> outside_preds;
+		for (BasicBlock *pred : predecessors.at(loop.header)) {
+			if (!loop.contains(pred)) {
+				outside_preds.push_back(pred);
+			}
+		}
+		if (outside_preds.size() != 1) {
+			return {};
+		}
+		Vec<Uptr<Instruction>> &insts = outside_preds[0]->get_inst();
+		for (auto it = insts.rbegin(); it != insts.rend(); ++it) {
+			if (get_def(**it) != var) {
+				continue;
+			}
+			InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(it->get());
+			return assignment ? get_number(assignment->get_source()) : Opt<int64_t> {};
+		}
+		return {};
+	}
+
+	Opt<int64_t> find_trip_count(const CountedLoop &counted, int64_t initial) {
+		Opt<int64_t> bound = get_number(counted.bound);
+		if (!bound) {
+			return {};
+		}
+		// the loop runs while the induction variable hasn't covered the
+		// distance to the bound
+		int64_t distance;
+		bool overflows = counted.step > 0
+			? __builtin_sub_overflow(*bound, initial, &distance)
+			: __builtin_sub_overflow(initial, *bound, &distance);
+		if (!overflows && (counted.op == Operator::le || counted.op == Operator::ge)) {
+			overflows = __builtin_add_overflow(distance, 1, &distance);
+		}
+		if (overflows || counted.step == std::numeric_limits<int64_t>::min()) {
+			return {};
+		}
+		int64_t stride = counted.step > 0 ? counted.step : -counted.step;
+		int64_t count = distance <= 0 ? 0 : distance / stride + (distance % stride != 0);
+		int64_t final_value;
+		if (__builtin_mul_overflow(count, counted.step, &final_value)
+			|| __builtin_add_overflow(initial, final_value, &final_value))
+		{
+			return {};
+		}
+		return count;
+	}
+
+	Set<Variable *> find_written_variables(const cfg::Loop &loop) {
+		Set<Variable *> defs;
+		for (BasicBlock *bb : loop.blocks) {
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				if (Opt<Variable *> def = get_def(*inst)) {
+					defs.insert(*def);
+				}
+			}
+		}
+		return defs;
+	}
+
+	Vec<NestedLoop> PerfectNest::get_levels() const {
+		return {
+			NestedLoop { &this->outer, &this->outer_counted },
+			NestedLoop { &this->inner, &this->inner_counted }
+		};
+	}
+
+	// returns the loop inside the outer one, if there is exactly one
+	Opt<const cfg::Loop *> find_only_inner_loop(const cfg::Loop &outer, const Vec<cfg::Loop> &loops) {
+		Opt<const cfg::Loop *> result;
+		for (const cfg::Loop &loop : loops) {
+			if (loop.header == outer.header || !outer.contains(loop.header)) {
+				continue;
+			}
+			if (result) {
+				return {};
+			}
+			result = &loop;
+		}
+		return result;
+	}
+
+	// returns whether the block has one successor, which is target
+	bool only_branches_to(BasicBlock *bb, BasicBlock *target) {
+		Vec<Pair<BasicBlock *, double>> &successors = bb->get_successors();
+		return successors.size() == 1 && successors[0].first == target;
+	}
+
+	Opt<PerfectNest> find_perfect_nest(const cfg::Loop &outer, const Vec<cfg::Loop> &loops, const cfg::DominatorTree &dominators) {
+		Opt<const cfg::Loop *> inner = find_only_inner_loop(outer, loops);
+		if (!inner) {
+			return {};
+		}
+		Opt<CountedLoop> outer_counted = analyze_counted_loop(outer, dominators);
+		Opt<CountedLoop> inner_counted = analyze_counted_loop(**inner, dominators);
+		if (!outer_counted || !inner_counted) {
+			return {};
+		}
+		Variable *outer_var = outer_counted->induction_var;
+		Variable *inner_var = inner_counted->induction_var;
+		BasicBlock *start = outer_counted->body;
+		BasicBlock *step = inner_counted->exit;
+		if (start == step
+			|| (*inner)->contains(start)
+			|| !outer.contains(step)
+			|| outer.blocks.size() != (*inner)->blocks.size() + 3
+			|| (*inner)->latches.size() != 1)
+		{
+			return {};
+		}
+
+		// the headers only test their induction variables
+		if (outer.header->get_inst().size() != 1 || (*inner)->header->get_inst().size() != 1) {
+			return {};
+		}
+
+		// the inner loop starts from and runs up to the same values every
+		// time
+		Set<Variable *> outer_defs = find_written_variables(outer);
+		Opt<Variable *> inner_bound = get_variable(inner_counted->bound);
+		if (inner_bound && outer_defs.count(*inner_bound)) {
+			return {};
+		}
+		Vec<Uptr<Instruction>> &start_insts = start->get_inst();
+		InstructionAssignment *initialization = start_insts.size() == 1
+			? dynamic_cast<InstructionAssignment *>(start_insts[0].get())
+			: nullptr;
+		if (!initialization || get_def(*initialization) != inner_var || !only_branches_to(start, (*inner)->header)) {
+			return {};
+		}
+		Opt<Variable *> initial_var = get_variable(initialization->get_source());
+		if (!get_number(initialization->get_source()) && !(initial_var && !outer_defs.count(*initial_var))) {
+			return {};
+		}
+
+		// the outer induction variable is only stepped after the inner loop
+		Vec<Uptr<Instruction>> &step_insts = step->get_inst();
+		if (step_insts.size() != 1
+			|| get_def(*step_insts[0]) != outer_var
+			|| get_uses(*step_insts[0]) != Vec<Variable *> { outer_var }
+			|| !only_branches_to(step, outer.header)
+			|| !find_loop_defs(**inner, outer_var).empty())
+		{
+			return {};
+		}
+
+		// nothing reads either induction variable once the inner one has been
+		// stepped
+		BasicBlock *inner_latch = (*inner)->latches[0];
+		Vec<Pair<BasicBlock *, int>> inner_defs = find_loop_defs(**inner, inner_var);
+		if (inner_defs.size() != 1 || inner_defs[0].first != inner_latch) {
+			return {};
+		}
+		int inner_step_index = inner_defs[0].second;
+		Vec<Uptr<Instruction>> &latch_insts = inner_latch->get_inst();
+		if (get_uses(*latch_insts[inner_step_index]) != Vec<Variable *> { inner_var }) {
+			return {};
+		}
+		for (int i = inner_step_index + 1; i < latch_insts.size(); ++i) {
+			if (uses_variable(*latch_insts[i], inner_var) || uses_variable(*latch_insts[i], outer_var)) {
+				return {};
+			}
+		}
+		return PerfectNest {
+			outer,
+			**inner,
+			mv(*outer_counted),
+			mv(*inner_counted),
+			start,
+			step,
+			inner_latch,
+			inner_step_index
+		};
+	}
+
+	Vec<cfg::Loop> find_innermost_loops(IRFunction &ir_function, const cfg::DominatorTree &dominators) {
+		Vec<cfg::Loop> loops = cfg::find_loops(ir_function, dominators);
+		Vec<cfg::Loop> result;
+		for (cfg::Loop &loop : loops) {
+			bool is_innermost = true;
+			for (const cfg::Loop &other : loops) {
+				if (other.header != loop.header && loop.contains(other.header)) {
+					is_innermost = false;
+				}
+			}
+			if (is_innermost) {
+				result.push_back(mv(loop));
+			}
+		}
+		return result;
+	}
+}
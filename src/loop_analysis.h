@@ -0,0 +1,76 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+#include "cfg.h"
+
+namespace IR::analysis {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// A loop which keeps going while `induction_var op bound` holds at the
+	// top of an iteration, and adds step to induction_var once per
+	// iteration.
+	struct CountedLoop {
+		Variable *induction_var;
+		int64_t step;
+		Operator op;
+		Uptr<Expr> bound;
+		// where the header goes to stay in the loop and to leave it
+		BasicBlock *body;
+		BasicBlock *exit;
+	};
+
+	// one loop of a nest, together with how it counts
+	struct NestedLoop {
+		const cfg::Loop *loop;
+		const CountedLoop *counted;
+	};
+
+	// Two counted loops, one inside the other. The outer loop's body is a
+	// block which only starts the inner loop, and the inner loop leaves to
+	// a block which only steps the outer induction variable, so the inner
+	// loop is all the outer loop runs.
+	struct PerfectNest {
+		const cfg::Loop &outer;
+		const cfg::Loop &inner;
+		CountedLoop outer_counted;
+		CountedLoop inner_counted;
+		// the block starting the inner loop and the one stepping the outer
+		// induction variable
+		BasicBlock *start;
+		BasicBlock *step;
+		// where the inner loop steps its induction variable
+		BasicBlock *inner_latch;
+		int inner_step_index;
+
+		// the two loops, outer first
+		Vec<NestedLoop> get_levels() const;
+	};
+
+	// returns the instructions in the loop that write to var, as blocks
+	// and indices into them
+	Vec<Pair<BasicBlock *, int>> find_loop_defs(const cfg::Loop &loop, Variable *var);
+
+	// returns the variables written to inside the loop
+	Set<Variable *> find_written_variables(const cfg::Loop &loop);
+
+	// Returns how the loop counts, if it tests an induction variable
+	// against a loop-invariant bound in its header and only leaves through
+	// that test.
+	Opt<CountedLoop> analyze_counted_loop(const cfg::Loop &loop, const cfg::DominatorTree &dominators);
+
+	// returns the value the induction variable starts with, if the only
+	// block entering the loop sets it to a constant
+	Opt<int64_t> find_initial_value(IRFunction &ir_function, const cfg::Loop &loop, Variable *var);
+
+	// Returns how many iterations the loop runs, if it's a constant. The
+	// induction variable must not overflow on the way.
+	Opt<int64_t> find_trip_count(const CountedLoop &counted, int64_t initial);
+
+	// Returns the perfect nest the loop is the outer loop of, if it is one.
+	// The inner loop runs from and up to the same values every time.
+	Opt<PerfectNest> find_perfect_nest(const cfg::Loop &outer, const Vec<cfg::Loop> &loops, const cfg::DominatorTree &dominators);
+
+	// returns the loops of the function which contain no other loop
+	Vec<cfg::Loop> find_innermost_loops(IRFunction &ir_function, const cfg::DominatorTree &dominators);
+}
@@ -0,0 +1,348 @@
+#include "loop_fusion.h"
+#include "analysis.h"
+#include "cfg.h"
+#include "dependence.h"
+#include "loop_analysis.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// Two loops, the second starting right after the first leaves. The
+	// first loop leaves to a block which only sets up the second one.
+	struct AdjacentLoops {
+		const cfg::Loop &first;
+		const cfg::Loop &second;
+		CountedLoop first_counted;
+		CountedLoop second_counted;
+		// the block between the loops
+		BasicBlock *between;
+	};
+
+	// returns the variables read inside the loop
+	Set<Variable *> find_read_variables(const cfg::Loop &loop) {
+		Set<Variable *> uses;
+		for (BasicBlock *bb : loop.blocks) {
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				for (Variable *var : get_uses(*inst)) {
+					uses.insert(var);
+				}
+			}
+			for (Variable *var : get_uses(*bb->get_terminator())) {
+				uses.insert(var);
+			}
+		}
+		return uses;
+	}
+
+	// returns the variables written to in the block
+	Set<Variable *> find_block_defs(BasicBlock *bb) {
+		Set<Variable *> defs;
+		for (const Uptr<Instruction> &inst : bb->get_inst()) {
+			if (Opt<Variable *> def = get_def(*inst)) {
+				defs.insert(*def);
+			}
+		}
+		return defs;
+	}
+
+	// returns whether two values are the same number or the same variable
+	bool is_same_value(const Uptr<Expr> &a, const Uptr<Expr> &b) {
+		Opt<int64_t> a_number = get_number(a);
+		Opt<Variable *> a_var = get_variable(a);
+		return (a_number && a_number == get_number(b)) || (a_var && a_var == get_variable(b));
+	}
+
+	// Returns the value var is last set to in the block, if it is a number
+	// or a variable the block doesn't write to afterwards.
+	Opt<const Uptr<Expr> *> find_initial_expr(BasicBlock *bb, Variable *var) {
+		Vec<Uptr<Instruction>> &insts = bb->get_inst();
+		Set<Variable *> defined_after;
+		for (auto it = insts.rbegin(); it != insts.rend(); ++it) {
+			Opt<Variable *> def = get_def(**it);
+			if (def != var) {
+				if (def) {
+					defined_after.insert(*def);
+				}
+				continue;
+			}
+			InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(it->get());
+			if (!assignment) {
+				return {};
+			}
+			const Uptr<Expr> &source = assignment->get_source();
+			Opt<Variable *> source_var = get_variable(source);
+			if (get_number(source) || (source_var && *source_var != var && !defined_after.count(*source_var))) {
+				return &source;
+			}
+			return {};
+		}
+		return {};
+	}
+
+	// returns the loop with the given header, if there is one
+	Opt<const cfg::Loop *> find_loop_with_header(const Vec<cfg::Loop> &loops, BasicBlock *header) {
+		for (const cfg::Loop &loop : loops) {
+			if (loop.header == header) {
+				return &loop;
+			}
+		}
+		return {};
+	}
+
+	// Returns the loop starting right after the first one leaves, if both
+	// are counted and run the same number of iterations. The induction
+	// variables start from the same value, step by the same amount and
+	// run up to the same bound.
+	Opt<AdjacentLoops> find_adjacent_loops(
+		const cfg::Loop &first,
+		const Vec<cfg::Loop> &loops,
+		const cfg::DominatorTree &dominators,
+		const Map<BasicBlock *, Vec<BasicBlock *>> &predecessors
+	) {
+		Opt<CountedLoop> first_counted = analyze_counted_loop(first, dominators);
+		if (!first_counted) {
+			return {};
+		}
+		BasicBlock *between = first_counted->exit;
+		Vec<Pair<BasicBlock *, double>> &successors = between->get_successors();
+		if (predecessors.at(between) != Vec<BasicBlock *> { first.header } || successors.size() != 1) {
+			return {};
+		}
+		Opt<const cfg::Loop *> second = find_loop_with_header(loops, successors[0].first);
+		if (!second || (*second)->contains(first.header)) {
+			return {};
+		}
+		Opt<CountedLoop> second_counted = analyze_counted_loop(**second, dominators);
+		// the second header is dropped, so it may only test the induction
+		// variable
+		if (!second_counted || (*second)->header->get_inst().size() != 1) {
+			return {};
+		}
+
+		// only one block enters each loop
+		Vec<BasicBlock *> entries;
+		for (BasicBlock *pred : predecessors.at(first.header)) {
+			if (!first.contains(pred)) {
+				entries.push_back(pred);
+			}
+		}
+		if (entries.size() != 1) {
+			return {};
+		}
+		for (BasicBlock *pred : predecessors.at((*second)->header)) {
+			if (pred != between && !(*second)->contains(pred)) {
+				return {};
+			}
+		}
+
+		// both loops count the same way
+		if (first_counted->step != second_counted->step
+			|| first_counted->op != second_counted->op
+			|| !is_same_value(first_counted->bound, second_counted->bound))
+		{
+			return {};
+		}
+		Opt<const Uptr<Expr> *> first_initial = find_initial_expr(entries[0], first_counted->induction_var);
+		Opt<const Uptr<Expr> *> second_initial = find_initial_expr(between, second_counted->induction_var);
+		if (!first_initial || !second_initial || !is_same_value(**first_initial, **second_initial)) {
+			return {};
+		}
+		// and the variables they start from and run up to hold the same
+		// values for both
+		Set<Variable *> changed_between = find_written_variables(first);
+		changed_between += find_block_defs(between);
+		for (const Uptr<Expr> *value : Vec<const Uptr<Expr> *> { *first_initial, &first_counted->bound }) {
+			Opt<Variable *> var = get_variable(*value);
+			if (var && changed_between.count(*var)) {
+				return {};
+			}
+		}
+		return AdjacentLoops {
+			first,
+			**second,
+			mv(*first_counted),
+			mv(*second_counted),
+			between
+		};
+	}
+
+	// Returns whether the bodies can run interleaved without seeing each
+	// other's values. A variable both loops use must be set before it is
+	// read in every iteration, and not be read after the loops. Neither
+	// loop may use the other's induction variable, unless it is the same
+	// one, and the second header's condition must not be used.
+	bool can_fuse_variables(IRFunction &ir_function, const AdjacentLoops &loops) {
+		Variable *first_var = loops.first_counted.induction_var;
+		Variable *second_var = loops.second_counted.induction_var;
+		Set<Variable *> first_defs = find_written_variables(loops.first);
+		Set<Variable *> first_uses = find_read_variables(loops.first);
+		Set<Variable *> second_defs = find_written_variables(loops.second);
+		Set<Variable *> second_vars = find_read_variables(loops.second);
+		second_vars += second_defs;
+		Set<Variable *> shared;
+		for (Variable *var : first_defs) {
+			if (second_vars.count(var)) {
+				shared.insert(var);
+			}
+		}
+		for (Variable *var : second_defs) {
+			if (first_uses.count(var)) {
+				shared.insert(var);
+			}
+		}
+		if (first_var != second_var && (shared.count(first_var) || shared.count(second_var))) {
+			return false;
+		}
+		shared.erase(first_var);
+
+		Liveness liveness = compute_liveness(ir_function);
+		Opt<Variable *> condition = get_def(*loops.second.header->get_inst()[0]);
+		if (!condition || liveness.live_out.at(loops.second.header).count(*condition)) {
+			return false;
+		}
+		for (Variable *var : shared) {
+			if (liveness.live_in.at(loops.first.header).count(var)
+				|| liveness.live_in.at(loops.second.header).count(var)
+				|| liveness.live_in.at(loops.second_counted.exit).count(var))
+			{
+				return false;
+			}
+		}
+
+		// the block between the loops runs before the first loop instead,
+		// so it may only compute values the first loop doesn't see from
+		// values the first loop doesn't change
+		for (const Uptr<Instruction> &inst : loops.between->get_inst()) {
+			if (dynamic_cast<InstructionDeclaration *>(inst.get())) {
+				continue;
+			}
+			if (!dynamic_cast<InstructionAssignment *>(inst.get()) || get_call(*inst)) {
+				return false;
+			}
+			for (Variable *var : get_uses(*inst)) {
+				if (first_defs.count(var)) {
+					return false;
+				}
+			}
+			Opt<Variable *> def = get_def(*inst);
+			if (def && *def != second_var && (first_defs.count(*def) || first_uses.count(*def))) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Returns whether no access of the second loop touches an element
+	// which a later iteration of the first loop touches too, unless both
+	// only read it, as the second loop's access would run first.
+	bool can_fuse_memory(IRFunction &ir_function, const AdjacentLoops &loops) {
+		NestedLoop first_level { &loops.first, &loops.first_counted };
+		NestedLoop second_level { &loops.second, &loops.second_counted };
+		Opt<Vec<MemoryAccess>> first_accesses = find_memory_accesses(ir_function, { first_level });
+		Opt<Vec<MemoryAccess>> second_accesses = find_memory_accesses(ir_function, { second_level });
+		if (!first_accesses || !second_accesses) {
+			return false;
+		}
+		// the induction variables go in lockstep, so the second loop's
+		// stands for the first one's. the second loop doesn't use the
+		// first one's otherwise
+		Variable *first_var = loops.first_counted.induction_var;
+		Variable *second_var = loops.second_counted.induction_var;
+		for (MemoryAccess &access : *second_accesses) {
+			for (Opt<AffineExpr> &index : access.indices) {
+				if (!index || first_var == second_var) {
+					continue;
+				}
+				auto it = index->coefficients.find(second_var);
+				if (it == index->coefficients.end()) {
+					continue;
+				}
+				int64_t coefficient = it->second;
+				index->coefficients.erase(it);
+				index->coefficients[first_var] = coefficient;
+			}
+		}
+		for (const MemoryAccess &source : *first_accesses) {
+			for (const MemoryAccess &sink : *second_accesses) {
+				if ((source.is_store || sink.is_store)
+					&& may_depend(source, sink, { first_level }, { Direction::backward }))
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Merges the second loop into the first. The first loop's iterations
+	// go on to the second loop's body instead of back to the header, and
+	// the second loop's go back to the first header, which leaves to
+	// where the second loop used to.
+	void fuse(IRFunction &ir_function, const AdjacentLoops &loops) {
+		Variable *first_var = loops.first_counted.induction_var;
+		BasicBlock *first_header = loops.first.header;
+		BasicBlock *preheader = cfg::get_or_create_preheader(ir_function, loops.first);
+
+		// the first loop steps its induction variable before the second
+		// body runs, so the second loop gets its own copy
+		if (loops.second_counted.induction_var == first_var) {
+			Variable *copy = cfg::declare_variable(ir_function, first_var->get_name() + "_fused", first_var->get_type());
+			Map<Variable *, Variable *> replacements { { first_var, copy } };
+			for (BasicBlock *bb : loops.second.blocks) {
+				for (Uptr<Instruction> &inst : bb->get_inst()) {
+					replace_variables(*inst, replacements);
+				}
+				replace_variables(*bb->get_terminator(), replacements);
+			}
+			for (Uptr<Instruction> &inst : loops.between->get_inst()) {
+				replace_variables(*inst, replacements);
+			}
+		}
+
+		Vec<Uptr<Instruction>> &between_insts = loops.between->get_inst();
+		for (Uptr<Instruction> &inst : between_insts) {
+			preheader->get_inst().push_back(mv(inst));
+		}
+		between_insts.clear();
+		for (BasicBlock *latch : loops.first.latches) {
+			cfg::redirect_edges(*latch, first_header, loops.second_counted.body);
+		}
+		for (BasicBlock *latch : loops.second.latches) {
+			cfg::redirect_edges(*latch, loops.second.header, first_header);
+		}
+		cfg::redirect_edges(*first_header, loops.between, loops.second_counted.exit);
+		// the block between the loops and the second header are left
+		// behind
+		cfg::remove_unreachable_blocks(ir_function);
+	}
+
+	// Fuses one pair of loops in the function, if any can be. Returns
+	// whether it did.
+	bool fuse_one_pair(IRFunction &ir_function) {
+		cfg::DominatorTree dominators = cfg::make_dominator_tree(ir_function);
+		Vec<cfg::Loop> loops = find_innermost_loops(ir_function, dominators);
+		Map<BasicBlock *, Vec<BasicBlock *>> predecessors = cfg::get_predecessors(ir_function);
+		for (const cfg::Loop &first : loops) {
+			Opt<AdjacentLoops> adjacent = find_adjacent_loops(first, loops, dominators, predecessors);
+			// the variables are checked first, as the memory accesses are
+			// compared assuming the second loop doesn't use the first
+			// loop's induction variable
+			if (!adjacent || !can_fuse_variables(ir_function, *adjacent) || !can_fuse_memory(ir_function, *adjacent)) {
+				continue;
+			}
+			fuse(ir_function, *adjacent);
+			return true;
+		}
+		return false;
+	}
+
+	bool fuse_loops(Program &program) {
+		bool changed = false;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			while (fuse_one_pair(*ir_function)) {
+				changed = true;
+			}
+		}
+		return changed;
+	}
+}
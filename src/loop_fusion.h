@@ -0,0 +1,19 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Loop fusion. Two innermost counted loops, the second starting right
+	// after the first leaves, are merged into one when they run the same
+	// number of iterations (same initial value, step and bound), so arrays
+	// they both walk are only walked once. Each iteration of the merged
+	// loop runs the first loop's body and then the second's. This is only
+	// done if no access of the second loop depends on one a later
+	// iteration of the first loop makes, and the variables the two bodies
+	// share are only temporaries within an iteration. Returns whether the
+	// program was changed.
+	bool fuse_loops(Program &program);
+}
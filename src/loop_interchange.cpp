@@ -0,0 +1,84 @@
+#include "loop_interchange.h"
+#include "analysis.h"
+#include "cfg.h"
+#include "dependence.h"
+#include "loop_analysis.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// makes the header's only instruction test `var op bound` and stay in
+	// the loop if that holds
+	void set_loop_test(BasicBlock *header, const CountedLoop &counted, BasicBlock *body, BasicBlock *exit) {
+		Uptr<Instruction> &test = header->get_inst()[0];
+		Variable *condition = *get_def(*test);
+		test = mkuptr<InstructionAssignment>(
+			mkuptr<ItemRef<Variable>>(condition),
+			mkuptr<BinaryOperation>(mkuptr<ItemRef<Variable>>(counted.induction_var), counted.bound->clone(), counted.op)
+		);
+		header->set_terminator(mkuptr<TerminatorBranchTwo>(
+			mkuptr<ItemRef<Variable>>(condition),
+			mkuptr<ItemRef<BasicBlock>>(body),
+			mkuptr<ItemRef<BasicBlock>>(exit)
+		));
+	}
+
+	// Swaps the roles of the two induction variables. The outer variable
+	// starts out where the inner one used to, and the start block puts the
+	// inner variable back to the outer one's initial value.
+	void interchange(IRFunction &ir_function, PerfectNest &nest) {
+		Variable *outer_var = nest.outer_counted.induction_var;
+		BasicBlock *preheader = cfg::get_or_create_preheader(ir_function, nest.outer);
+		Variable *initial = cfg::declare_variable(ir_function, outer_var->get_name() + "_initial", Type(A_type::int64, 0));
+		Vec<Uptr<Instruction>> &preheader_insts = preheader->get_inst();
+		preheader_insts.push_back(mkuptr<InstructionAssignment>(
+			mkuptr<ItemRef<Variable>>(initial),
+			mkuptr<ItemRef<Variable>>(outer_var)
+		));
+		Uptr<Instruction> &start = nest.start->get_inst()[0];
+		preheader_insts.push_back(mv(start));
+		start = mkuptr<InstructionAssignment>(
+			mkuptr<ItemRef<Variable>>(outer_var),
+			mkuptr<ItemRef<Variable>>(initial)
+		);
+		std::swap(nest.step->get_inst()[0], nest.inner_latch->get_inst()[nest.inner_step_index]);
+		set_loop_test(nest.outer.header, nest.inner_counted, nest.start, nest.outer_counted.exit);
+		set_loop_test(nest.inner.header, nest.outer_counted, nest.inner_counted.body, nest.step);
+	}
+
+	// Interchanges one nest in the function, if any is worth it. Returns
+	// whether it did.
+	bool interchange_one_nest(IRFunction &ir_function) {
+		cfg::DominatorTree dominators = cfg::make_dominator_tree(ir_function);
+		Vec<cfg::Loop> loops = cfg::find_loops(ir_function, dominators);
+		for (const cfg::Loop &outer : loops) {
+			Opt<PerfectNest> nest = find_perfect_nest(outer, loops, dominators);
+			if (!nest) {
+				continue;
+			}
+			Opt<Vec<MemoryAccess>> accesses = find_memory_accesses(ir_function, nest->get_levels());
+			if (!accesses
+				|| count_strided_accesses(*accesses, nest->inner_counted.induction_var)
+					<= count_strided_accesses(*accesses, nest->outer_counted.induction_var)
+				|| !can_interchange(ir_function, *nest, *accesses))
+			{
+				continue;
+			}
+			interchange(ir_function, *nest);
+			return true;
+		}
+		return false;
+	}
+
+	bool interchange_loops(Program &program) {
+		bool changed = false;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			// an interchanged nest strides less in its new inner loop, so
+			// it isn't interchanged back
+			while (interchange_one_nest(*ir_function)) {
+				changed = true;
+			}
+		}
+		return changed;
+	}
+}
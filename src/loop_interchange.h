@@ -0,0 +1,18 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Loop interchange. Arrays are laid out row-major, so a nest of two
+	// loops whose inner loop steps through an index other than the last one
+	// jumps across memory on every iteration. Such a nest is turned inside
+	// out if it is perfect (the outer loop does nothing but run the inner
+	// one and step its own induction variable), the inner loop's bounds
+	// don't depend on the outer one, and no value flows between iterations
+	// whose order would flip, through memory or through variables other
+	// than sums and products. Returns whether the program was changed.
+	bool interchange_loops(Program &program);
+}
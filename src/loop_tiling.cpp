@@ -0,0 +1,198 @@
+#include "loop_tiling.h"
+#include "analysis.h"
+#include "cfg.h"
+#include "dependence.h"
+#include "loop_analysis.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	int64_t get_tile_size(int64_t cache_size) {
+		// a tile of each of the arrays read and written, with 8 bytes per
+		// element, rounded down to a power of two
+		int64_t size = 1;
+		while (2 * (2 * size) * (2 * size) * 8 <= cache_size) {
+			size *= 2;
+		}
+		return size;
+	}
+
+	Uptr<ItemRef<Variable>> make_ref(Variable *var) {
+		return mkuptr<ItemRef<Variable>>(var);
+	}
+
+	Uptr<Instruction> make_assignment(Variable *dest, Uptr<Expr> source) {
+		return mkuptr<InstructionAssignment>(make_ref(dest), mv(source));
+	}
+
+	Uptr<Instruction> make_operation(Variable *dest, Uptr<Expr> lhs, Operator op, Uptr<Expr> rhs) {
+		return make_assignment(dest, mkuptr<BinaryOperation>(mv(lhs), mv(rhs), op));
+	}
+
+	// returns whether the loop may run more iterations than fit in a tile
+	bool spans_several_tiles(const CountedLoop &counted, const Uptr<Expr> &initial, int64_t tile_size) {
+		Opt<int64_t> initial_value = get_number(initial);
+		Opt<int64_t> count = initial_value ? find_trip_count(counted, *initial_value) : Opt<int64_t> {};
+		return !count || *count > tile_size;
+	}
+
+	// The variables running one loop of the nest over tiles: the first
+	// value of the induction variable in the current tile, and the value
+	// it stops at.
+	struct TileVariables {
+		Variable *start;
+		Variable *end;
+	};
+
+	TileVariables declare_tile_variables(IRFunction &ir_function, const CountedLoop &counted) {
+		Type int64_type(A_type::int64, 0);
+		const std::string &name = counted.induction_var->get_name();
+		return TileVariables {
+			cfg::declare_variable(ir_function, name + "_tile", int64_type),
+			cfg::declare_variable(ir_function, name + "_tile_end", int64_type)
+		};
+	}
+
+	// Appends code computing where the tile starting at tile.start ends:
+	// distance further on, unless that's past the loop's bound or wraps
+	// around, in which case the tile ends at the bound. The choice is made
+	// with a mask rather than a branch, so the nest keeps its shape.
+	void compute_tile_end(
+		IRFunction &ir_function,
+		BasicBlock *bb,
+		const CountedLoop &counted,
+		const TileVariables &tile,
+		int64_t distance
+	) {
+		Type int64_type(A_type::int64, 0);
+		Variable *fits = cfg::declare_variable(ir_function, "tile_fits", int64_type);
+		Variable *offset = cfg::declare_variable(ir_function, "tile_offset", int64_type);
+		Vec<Uptr<Instruction>> &insts = bb->get_inst();
+		insts.push_back(make_operation(tile.end, make_ref(tile.start), Operator::plus, mkuptr<NumberLiteral>(distance)));
+		insts.push_back(make_operation(fits, make_ref(tile.start), counted.op, make_ref(tile.end)));
+		insts.push_back(make_operation(offset, make_ref(tile.end), counted.op, counted.bound->clone()));
+		insts.push_back(make_operation(fits, make_ref(fits), Operator::bitwise_and, make_ref(offset)));
+		insts.push_back(make_operation(fits, mkuptr<NumberLiteral>(0), Operator::minus, make_ref(fits)));
+		insts.push_back(make_operation(offset, make_ref(tile.end), Operator::minus, counted.bound->clone()));
+		insts.push_back(make_operation(offset, make_ref(offset), Operator::bitwise_and, make_ref(fits)));
+		insts.push_back(make_operation(tile.end, counted.bound->clone(), Operator::plus, make_ref(offset)));
+	}
+
+	// makes the block test `var op bound` and go to body if that holds
+	void set_tile_test(BasicBlock *bb, Variable *condition, Variable *var, const CountedLoop &counted, Uptr<Expr> bound, BasicBlock *body, BasicBlock *exit) {
+		bb->get_inst().push_back(make_operation(condition, make_ref(var), counted.op, mv(bound)));
+		bb->set_terminator(mkuptr<TerminatorBranchTwo>(
+			make_ref(condition),
+			mkuptr<ItemRef<BasicBlock>>(body),
+			mkuptr<ItemRef<BasicBlock>>(exit)
+		));
+	}
+
+	void set_jump(BasicBlock *bb, BasicBlock *target) {
+		bb->set_terminator(mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(target)));
+	}
+
+	// Wraps the nest in two loops over tiles, which become the outer
+	// loops. The original loops stay innermost and run over the current
+	// tile only.
+	void tile(IRFunction &ir_function, PerfectNest &nest, int64_t outer_distance, int64_t inner_distance) {
+		const CountedLoop &outer = nest.outer_counted;
+		const CountedLoop &inner = nest.inner_counted;
+		BasicBlock *outer_header = nest.outer.header;
+		BasicBlock *inner_header = nest.inner.header;
+		Variable *outer_condition = *get_def(*outer_header->get_inst()[0]);
+		Variable *inner_condition = *get_def(*inner_header->get_inst()[0]);
+		TileVariables outer_tile = declare_tile_variables(ir_function, outer);
+		TileVariables inner_tile = declare_tile_variables(ir_function, inner);
+
+		BasicBlock *preheader = cfg::get_or_create_preheader(ir_function, nest.outer);
+		BasicBlock *outer_tile_header = cfg::insert_block_before(ir_function, outer_header, outer_header->get_name() + "_tiles");
+		BasicBlock *outer_tile_body = cfg::insert_block_before(ir_function, outer_header, outer_header->get_name() + "_tile");
+		BasicBlock *inner_tile_header = cfg::insert_block_before(ir_function, outer_header, inner_header->get_name() + "_tiles");
+		BasicBlock *inner_tile_body = cfg::insert_block_before(ir_function, outer_header, inner_header->get_name() + "_tile");
+		BasicBlock *inner_tile_latch = cfg::insert_block_before(ir_function, outer_header, inner_header->get_name() + "_next_tile");
+		BasicBlock *outer_tile_latch = cfg::insert_block_before(ir_function, outer_header, outer_header->get_name() + "_next_tile");
+
+		// the outer tiles start where the outer loop did
+		preheader->get_inst().push_back(make_assignment(outer_tile.start, make_ref(outer.induction_var)));
+		cfg::redirect_edges(*preheader, outer_header, outer_tile_header);
+		set_tile_test(outer_tile_header, outer_condition, outer_tile.start, outer, outer.bound->clone(), outer_tile_body, outer.exit);
+
+		// and the inner tiles where the inner loop did
+		Uptr<Instruction> &inner_start = nest.start->get_inst()[0];
+		Uptr<Expr> &inner_initial = dynamic_cast<InstructionAssignment &>(*inner_start).get_source();
+		compute_tile_end(ir_function, outer_tile_body, outer, outer_tile, outer_distance);
+		outer_tile_body->get_inst().push_back(make_assignment(inner_tile.start, inner_initial->clone()));
+		set_jump(outer_tile_body, inner_tile_header);
+		set_tile_test(inner_tile_header, inner_condition, inner_tile.start, inner, inner.bound->clone(), inner_tile_body, outer_tile_latch);
+
+		// the original loops run over the tile
+		compute_tile_end(ir_function, inner_tile_body, inner, inner_tile, inner_distance);
+		inner_tile_body->get_inst().push_back(make_assignment(outer.induction_var, make_ref(outer_tile.start)));
+		set_jump(inner_tile_body, outer_header);
+		outer_header->get_inst().clear();
+		set_tile_test(outer_header, outer_condition, outer.induction_var, outer, make_ref(outer_tile.end), nest.start, inner_tile_latch);
+		inner_start = make_assignment(inner.induction_var, make_ref(inner_tile.start));
+		inner_header->get_inst().clear();
+		set_tile_test(inner_header, inner_condition, inner.induction_var, inner, make_ref(inner_tile.end), inner.body, nest.step);
+
+		// each tile starts where the last one ended
+		inner_tile_latch->get_inst().push_back(make_assignment(inner_tile.start, make_ref(inner_tile.end)));
+		set_jump(inner_tile_latch, inner_tile_header);
+		outer_tile_latch->get_inst().push_back(make_assignment(outer_tile.start, make_ref(outer_tile.end)));
+		set_jump(outer_tile_latch, outer_tile_header);
+	}
+
+	// returns how far the induction variable moves in a tile, if the loop
+	// can be tiled
+	Opt<int64_t> get_tile_distance(const CountedLoop &counted, int64_t tile_size) {
+		// the tile end is an exclusive bound
+		if (counted.op != Operator::lt && counted.op != Operator::gt) {
+			return {};
+		}
+		int64_t distance;
+		if (__builtin_mul_overflow(counted.step, tile_size, &distance)) {
+			return {};
+		}
+		return distance;
+	}
+
+	bool tile_loops_in(IRFunction &ir_function, int64_t tile_size) {
+		cfg::DominatorTree dominators = cfg::make_dominator_tree(ir_function);
+		Vec<cfg::Loop> loops = cfg::find_loops(ir_function, dominators);
+		// the nests are disjoint, so they're all found before any is tiled
+		Vec<Pair<PerfectNest, Pair<int64_t, int64_t>>> tiled;
+		for (const cfg::Loop &outer : loops) {
+			Opt<PerfectNest> nest = find_perfect_nest(outer, loops, dominators);
+			if (!nest) {
+				continue;
+			}
+			Opt<int64_t> outer_distance = get_tile_distance(nest->outer_counted, tile_size);
+			Opt<int64_t> inner_distance = get_tile_distance(nest->inner_counted, tile_size);
+			Uptr<Expr> &inner_initial = dynamic_cast<InstructionAssignment &>(*nest->start->get_inst()[0]).get_source();
+			if (!outer_distance || !inner_distance || !spans_several_tiles(nest->inner_counted, inner_initial, tile_size)) {
+				continue;
+			}
+			Opt<Vec<MemoryAccess>> accesses = find_memory_accesses(ir_function, nest->get_levels());
+			if (!accesses
+				|| count_strided_accesses(*accesses, nest->inner_counted.induction_var) == 0
+				|| !can_interchange(ir_function, *nest, *accesses))
+			{
+				continue;
+			}
+			tiled.emplace_back(mv(*nest), Pair<int64_t, int64_t> { *outer_distance, *inner_distance });
+		}
+		for (auto &[nest, distances] : tiled) {
+			tile(ir_function, nest, distances.first, distances.second);
+		}
+		return !tiled.empty();
+	}
+
+	bool tile_loops(Program &program, int64_t tile_size) {
+		bool changed = false;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			changed |= tile_loops_in(*ir_function, tile_size);
+		}
+		return changed;
+	}
+}
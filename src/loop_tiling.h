@@ -0,0 +1,24 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// the bytes of data cache the tiles of a loop nest should fit in
+	const int64_t tile_cache_size = 256 * 1024;
+
+	// returns how many iterations of each loop a tile spans, so that the
+	// elements a tile reads and those it writes fit in cache_size bytes
+	int64_t get_tile_size(int64_t cache_size);
+
+	// Loop tiling. A perfect nest of two loops which still steps through a
+	// non-last array index in its inner loop (after interchange had its
+	// go) is split into square tiles of tile_size by tile_size iterations,
+	// run one after the other, so each tile works on a part of the arrays
+	// small enough to stay in the cache. Tiling reorders iterations the way
+	// interchange does, so it has the same requirements. Returns whether
+	// the program was changed.
+	bool tile_loops(Program &program, int64_t tile_size);
+}
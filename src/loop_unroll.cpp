@@ -0,0 +1,158 @@
+#include "loop_unroll.h"
+#include "analysis.h"
+#include "cfg.h"
+#include "loop_analysis.h"
+#include <limits>
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// the most copies of its body a loop with an unknown trip count gets
+	const int64_t max_unroll_factor = 4;
+
+	// returns how many instructions the unrolled copies of a loop may have
+	int64_t get_unrolled_size_limit(int32_t opt_level) {
+		return 24 * opt_level;
+	}
+
+	// returns how many instructions unrolling may add to one function
+	int64_t get_unroll_budget(int32_t opt_level) {
+		return 64 * opt_level;
+	}
+
+	// Replaces the loop by count copies of it that don't test the
+	// induction variable, followed by a copy of the header that leaves.
+	void unroll_fully(IRFunction &ir_function, const cfg::Loop &loop, const CountedLoop &counted, int64_t count) {
+		BasicBlock *preheader = cfg::get_or_create_preheader(ir_function, loop);
+		Vec<Map<BasicBlock *, BasicBlock *>> copies;
+		for (int64_t i = 0; i <= count; ++i) {
+			copies.push_back(cfg::clone_loop(ir_function, loop, "_unrolled"));
+		}
+		for (int64_t i = 0; i <= count; ++i) {
+			BasicBlock *header = copies[i].at(loop.header);
+			BasicBlock *target = i < count ? copies[i].at(counted.body) : counted.exit;
+			header->set_terminator(mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(target)));
+			if (i < count) {
+				for (BasicBlock *latch : loop.latches) {
+					cfg::redirect_edges(*copies[i].at(latch), header, copies[i + 1].at(loop.header));
+				}
+			}
+		}
+		cfg::redirect_edges(*preheader, loop.header, copies[0].at(loop.header));
+		cfg::remove_unreachable_blocks(ir_function);
+	}
+
+	// Adds a loop in front of the original one which runs factor copies
+	// of the body each time around. It keeps going while the induction
+	// variable is far enough from the bound for all of them to run; the
+	// original loop then runs whatever is left. Returns the block testing
+	// the stricter bound, which is the header of the new loop.
+	BasicBlock *unroll_partially(IRFunction &ir_function, const cfg::Loop &loop, const CountedLoop &counted, int64_t factor) {
+		int64_t distance = (factor - 1) * counted.step;
+		BasicBlock *preheader = cfg::get_or_create_preheader(ir_function, loop);
+		Type int64_type(A_type::int64, 0);
+		Variable *limit = cfg::declare_variable(ir_function, counted.induction_var->get_name() + "_limit", int64_type);
+		Variable *condition = cfg::declare_variable(ir_function, counted.induction_var->get_name() + "_unroll", int64_type);
+		auto make_ref = [](Variable *var) { return mkuptr<ItemRef<Variable>>(var); };
+
+		// the stricter bound is only usable if computing it doesn't wrap
+		// around
+		Vec<Uptr<Instruction>> &preheader_insts = preheader->get_inst();
+		preheader_insts.push_back(mkuptr<InstructionAssignment>(
+			make_ref(limit),
+			mkuptr<BinaryOperation>(counted.bound->clone(), mkuptr<NumberLiteral>(-distance), Operator::plus)
+		));
+		preheader_insts.push_back(mkuptr<InstructionAssignment>(
+			make_ref(condition),
+			counted.step > 0
+				? mkuptr<BinaryOperation>(make_ref(limit), counted.bound->clone(), Operator::lt)
+				: mkuptr<BinaryOperation>(counted.bound->clone(), make_ref(limit), Operator::lt)
+		));
+
+		Vec<Map<BasicBlock *, BasicBlock *>> copies;
+		for (int64_t i = 0; i < factor; ++i) {
+			copies.push_back(cfg::clone_loop(ir_function, loop, "_unrolled"));
+		}
+		BasicBlock *test = cfg::insert_block_before(ir_function, copies[0].at(loop.header), loop.header->get_name() + "_unrolled_test");
+		test->get_inst().push_back(mkuptr<InstructionAssignment>(
+			make_ref(condition),
+			mkuptr<BinaryOperation>(make_ref(counted.induction_var), make_ref(limit), counted.op)
+		));
+		test->set_terminator(mkuptr<TerminatorBranchTwo>(
+			make_ref(condition),
+			mkuptr<ItemRef<BasicBlock>>(copies[0].at(loop.header)),
+			mkuptr<ItemRef<BasicBlock>>(loop.header)
+		));
+		for (int64_t i = 0; i < factor; ++i) {
+			BasicBlock *header = copies[i].at(loop.header);
+			header->set_terminator(mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(copies[i].at(counted.body))));
+			BasicBlock *next = i + 1 < factor ? copies[i + 1].at(loop.header) : test;
+			for (BasicBlock *latch : loop.latches) {
+				cfg::redirect_edges(*copies[i].at(latch), header, next);
+			}
+		}
+		preheader->set_terminator(mkuptr<TerminatorBranchTwo>(
+			make_ref(condition),
+			mkuptr<ItemRef<BasicBlock>>(test),
+			mkuptr<ItemRef<BasicBlock>>(loop.header)
+		));
+		return test;
+	}
+
+	bool unroll_loops_in(IRFunction &ir_function, int32_t opt_level) {
+		bool changed = false;
+		int64_t budget = get_unroll_budget(opt_level);
+		int64_t size_limit = get_unrolled_size_limit(opt_level);
+		// the headers of the loops that have been looked at, including the
+		// loops made by unrolling
+		Set<BasicBlock *> visited;
+		while (true) {
+			// unrolling changes the CFG, so the loops are found again
+			cfg::DominatorTree dominators = cfg::make_dominator_tree(ir_function);
+			Opt<cfg::Loop> loop;
+			Opt<CountedLoop> counted;
+			for (cfg::Loop &candidate : find_innermost_loops(ir_function, dominators)) {
+				if (visited.count(candidate.header)) {
+					continue;
+				}
+				visited.insert(candidate.header);
+				counted = analyze_counted_loop(candidate, dominators);
+				if (counted) {
+					loop = mv(candidate);
+					break;
+				}
+			}
+			if (!loop) {
+				return changed;
+			}
+			int64_t size = loop->get_size();
+			int64_t limit = std::min(size_limit, budget);
+			Opt<int64_t> initial = find_initial_value(ir_function, *loop, counted->induction_var);
+			Opt<int64_t> count = initial ? find_trip_count(*counted, *initial) : Opt<int64_t> {};
+			if (count && *count <= limit / size - 1) {
+				unroll_fully(ir_function, *loop, *counted, *count);
+				budget -= *count * size;
+				changed = true;
+				continue;
+			}
+			int64_t factor = std::min(max_unroll_factor, limit / size);
+			int64_t distance;
+			if (factor >= 2
+				&& !__builtin_mul_overflow(factor - 1, counted->step, &distance)
+				&& distance != std::numeric_limits<int64_t>::min())
+			{
+				visited.insert(unroll_partially(ir_function, *loop, *counted, factor));
+				budget -= factor * size;
+				changed = true;
+			}
+		}
+	}
+
+	bool unroll_loops(Program &program, int32_t opt_level) {
+		bool changed = false;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			changed |= unroll_loops_in(*ir_function, opt_level);
+		}
+		return changed;
+	}
+}
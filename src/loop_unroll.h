@@ -0,0 +1,19 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Loop unrolling. Innermost loops that test an induction variable
+	// against a loop-invariant bound at the top of each iteration, and only
+	// leave through that test, are unrolled. If the number of iterations is
+	// a small constant, the loop is replaced by that many copies of its
+	// body. Otherwise the loop runs several copies of its body per test of
+	// a stricter bound, and the original loop runs the iterations that are
+	// left over. The copies are chained by unconditional branches so they
+	// end up in a single trace. Code growth is capped per loop and per
+	// function. Returns whether the program was changed.
+	bool unroll_loops(Program &program, int32_t opt_level);
+}
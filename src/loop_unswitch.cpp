@@ -0,0 +1,120 @@
+#include "loop_unswitch.h"
+#include "analysis.h"
+#include "cfg.h"
+#include "loop_analysis.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// returns how many instructions a loop may have to be copied
+	int64_t get_unswitch_size_limit(int32_t opt_level) {
+		return 16 * opt_level;
+	}
+
+	// returns how many instructions unswitching may add to one function
+	int64_t get_unswitch_budget(int32_t opt_level) {
+		return 64 * opt_level;
+	}
+
+	// Returns an expression which computes the condition of the block's
+	// branch before the loop, if there is one. That's the condition
+	// itself if nothing in the loop writes to it, or else the operation
+	// which computed it in the block, if nothing in the loop writes to its
+	// operands.
+	Opt<Uptr<Expr>> get_invariant_condition(BasicBlock *bb, const Set<Variable *> &loop_defs) {
+		Uptr<Expr> &condition = *bb->get_terminator()->get_operands()[0];
+		Opt<Variable *> var = get_variable(condition);
+		if (!var) {
+			return {};
+		}
+		if (!loop_defs.count(*var)) {
+			return condition->clone();
+		}
+		Vec<Uptr<Instruction>> &insts = bb->get_inst();
+		for (auto it = insts.rbegin(); it != insts.rend(); ++it) {
+			if (get_def(**it) != var) {
+				continue;
+			}
+			InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(it->get());
+			BinaryOperation *bin_op = assignment ? dynamic_cast<BinaryOperation *>(assignment->get_source().get()) : nullptr;
+			if (!bin_op) {
+				return {};
+			}
+			for (const Uptr<Expr> *operand : { &bin_op->get_lhs(), &bin_op->get_rhs() }) {
+				Opt<Variable *> operand_var = get_variable(*operand);
+				if (operand_var && loop_defs.count(*operand_var)) {
+					return {};
+				}
+			}
+			return bin_op->clone();
+		}
+		return {};
+	}
+
+	// Unswitches one branch of one loop, if any fits in the budget.
+	// Returns the size of the loop that was copied.
+	Opt<int64_t> unswitch_one_branch(IRFunction &ir_function, int64_t size_limit) {
+		cfg::DominatorTree dominators = cfg::make_dominator_tree(ir_function);
+		Vec<cfg::Loop> loops = cfg::find_loops(ir_function, dominators);
+		// inner loops come first, so go backwards
+		for (auto loop_it = loops.rbegin(); loop_it != loops.rend(); ++loop_it) {
+			const cfg::Loop &loop = *loop_it;
+			int64_t size = loop.get_size();
+			if (size > size_limit) {
+				continue;
+			}
+			Set<Variable *> loop_defs = find_written_variables(loop);
+			for (size_t i = 0; i < ir_function.get_blocks().size(); ++i) {
+				BasicBlock *bb = ir_function.get_blocks()[i].get();
+				TerminatorBranchTwo *branch = dynamic_cast<TerminatorBranchTwo *>(bb->get_terminator().get());
+				if (!loop.contains(bb)
+					|| !branch
+					|| !loop.contains(*branch->get_branch_true().get_referent())
+					|| !loop.contains(*branch->get_branch_false().get_referent()))
+				{
+					continue;
+				}
+				Opt<Uptr<Expr>> condition = get_invariant_condition(bb, loop_defs);
+				if (!condition) {
+					continue;
+				}
+				if (dynamic_cast<BinaryOperation *>(condition->get())) {
+					// the preheader computes the condition into a new variable
+					Variable *var = cfg::declare_variable(
+						ir_function,
+						(*get_variable(*branch->get_operands()[0]))->get_name() + "_invariant",
+						Type(A_type::int64, 0)
+					);
+					BasicBlock *preheader = cfg::get_or_create_preheader(ir_function, loop);
+					preheader->get_inst().push_back(mkuptr<InstructionAssignment>(
+						mkuptr<ItemRef<Variable>>(var),
+						mv(*condition)
+					));
+					condition = mkuptr<ItemRef<Variable>>(var);
+				}
+				BasicBlock *true_target = *branch->get_branch_true().get_referent();
+				BasicBlock *false_target = *branch->get_branch_false().get_referent();
+				Map<BasicBlock *, BasicBlock *> copies = cfg::version_loop(ir_function, loop, mv(*condition), "_unswitched");
+				bb->set_terminator(mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(true_target)));
+				copies.at(bb)->set_terminator(mkuptr<TerminatorBranchOne>(
+					mkuptr<ItemRef<BasicBlock>>(copies.at(false_target))
+				));
+				return size;
+			}
+		}
+		return {};
+	}
+
+	bool unswitch_loops(Program &program, int32_t opt_level) {
+		bool changed = false;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			int64_t budget = get_unswitch_budget(opt_level);
+			// each unswitched branch becomes a jump, so this ends
+			while (Opt<int64_t> size = unswitch_one_branch(*ir_function, std::min(budget, get_unswitch_size_limit(opt_level)))) {
+				budget -= *size;
+				changed = true;
+			}
+		}
+		return changed;
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Loop unswitching. A branch inside a loop whose condition doesn't
+	// change while the loop runs (or is computed from values that don't)
+	// is tested once before the loop instead: the loop is copied, the
+	// original keeps only the branch's true side and the copy only its
+	// false side, and the preheader picks one of them. Outer loops are
+	// unswitched first, so the test leaves as many loops as possible.
+	// Code growth is capped per loop and per function. Returns whether the
+	// program was changed.
+	bool unswitch_loops(Program &program, int32_t opt_level);
+}
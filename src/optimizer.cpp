@@ -0,0 +1,109 @@
+#include "optimizer.h"
+#include "alloc_hoist.h"
+#include "call_graph.h"
+#include "const_eval.h"
+#include "const_prop.h"
+#include "copy_prop.h"
+#include "dead_code.h"
+#include "function_merging.h"
+#include "inliner.h"
+#include "inst_combine.h"
+#include "ip_const_prop.h"
+#include "licm.h"
+#include "loop_fusion.h"
+#include "loop_interchange.h"
+#include "loop_tiling.h"
+#include "loop_unroll.h"
+#include "loop_unswitch.h"
+#include "range_prop.h"
+#include "scalar_replace.h"
+#include "simplify_cfg.h"
+#include "tagged_ints.h"
+#include "tail_calls.h"
+#include "value_numbering.h"
+
+namespace IR::optimizer {
+	void optimize_ir_function(IRFunction &ir_function, int32_t opt_level, const call_graph::SummaryMap &summaries) {
+		propagate_constants(ir_function);
+		simplify_cfg(ir_function);
+		propagate_copies(ir_function);
+		// combining can expose constants, and the other way around
+		bool progress = true;
+		while (progress) {
+			progress = combine_instructions(ir_function);
+			progress |= propagate_constants(ir_function);
+		}
+		// level 1 stops at the local cleanups. the analyses over the whole
+		// function come from level 2 on
+		if (opt_level >= 2) {
+			// indices made constant above let aggregates become variables,
+			// whose values are then propagated in turn
+			if (replace_aggregates(ir_function)) {
+				propagate_constants(ir_function);
+				propagate_copies(ir_function);
+			}
+			eliminate_tag_conversions(ir_function);
+			fold_decided_comparisons(ir_function);
+			eliminate_tail_calls(ir_function);
+			eliminate_common_subexpressions(ir_function, summaries);
+			move_loop_invariant_code(ir_function, summaries);
+			propagate_copies(ir_function);
+		}
+		eliminate_dead_code(ir_function, summaries);
+		simplify_cfg(ir_function);
+		coalesce_copies(ir_function);
+	}
+
+	void optimize_functions(Program &program, int32_t opt_level) {
+		call_graph::CallGraph call_graph(program);
+		call_graph::SummaryMap summaries = call_graph::summarize_functions(program, call_graph);
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			optimize_ir_function(*ir_function, opt_level, summaries);
+		}
+		// optimizing may have removed the last calls to some functions
+		call_graph::remove_unreachable_functions(program);
+	}
+
+	void optimize_program(Program &program, int32_t opt_level, bool optimize_size) {
+		if (opt_level <= 0) {
+			return;
+		}
+		optimize_functions(program, opt_level);
+		// constants are passed into callees, calls left with only constant
+		// arguments are evaluated, and callees are inlined once they've been
+		// made as small as possible, then everything is cleaned up again.
+		// loops are fused, interchanged, tiled, unswitched and unrolled
+		// last, once their bodies are as small as they get. allocations
+		// leave loops after the nests have been reshaped, as the loops
+		// resetting them would keep the nests from being perfect
+		if (propagate_constants_across_calls(program, opt_level, optimize_size)) {
+			optimize_functions(program, opt_level);
+		}
+		if (evaluate_constant_calls(program)) {
+			optimize_functions(program, opt_level);
+		}
+		if (inline_functions(program, opt_level, optimize_size)) {
+			optimize_functions(program, opt_level);
+		}
+		if (fuse_loops(program)) {
+			optimize_functions(program, opt_level);
+		}
+		if (interchange_loops(program)) {
+			optimize_functions(program, opt_level);
+		}
+		if (!optimize_size && tile_loops(program, get_tile_size(tile_cache_size))) {
+			optimize_functions(program, opt_level);
+		}
+		if (hoist_allocations(program)) {
+			optimize_functions(program, opt_level);
+		}
+		if (!optimize_size && unswitch_loops(program, opt_level)) {
+			optimize_functions(program, opt_level);
+		}
+		if (!optimize_size && unroll_loops(program, opt_level)) {
+			optimize_functions(program, opt_level);
+		}
+		// functions are merged once they are as alike as they'll get
+		merge_identical_functions(program);
+	}
+}
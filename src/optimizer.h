@@ -0,0 +1,15 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Runs the optimization passes enabled at the given optimization level
+	// over every function of the program. Level 0 leaves the program as is.
+	// When optimizing for size, passes that copy code (specialization,
+	// loop tiling, unswitching and unrolling) are left out and only calls
+	// no bigger than their callee's body are inlined.
+	void optimize_program(Program &program, int32_t opt_level, bool optimize_size);
+}
@@ -0,0 +1,104 @@
+#include "outliner.h"
+#include "target_arch.h"
+#include "tracer.h"
+#include <algorithm>
+
+namespace IR::code_gen {
+	using namespace IR::tracer;
+
+	// accesses in blocks at least as popular as an average block keep
+	// their address computation inline
+	const double max_outlined_hotness = 1.0;
+
+	// besides moving its arguments, a call stores its return address,
+	// jumps, places its return label and moves the result
+	const int64_t call_overhead = 4;
+
+	int64_t count_instructions(const std::string &code) {
+		return std::count(code.begin(), code.end(), '\n');
+	}
+
+	Opt<MemoryLocation *> get_location(Instruction &inst) {
+		if (InstructionLoad *load = dynamic_cast<InstructionLoad *>(&inst)) {
+			return &load->get_location();
+		}
+		if (InstructionStore *store = dynamic_cast<InstructionStore *>(&inst)) {
+			return &store->get_location();
+		}
+		return {};
+	}
+
+	// the parameters of an outlined address computation: the array, then
+	// the indices
+	Vec<std::string> get_parameters(MemoryLocation &location) {
+		Vec<std::string> parameters = { "%a" };
+		for (int i = 0; i < location.get_dimensions().size(); ++i) {
+			parameters.push_back("%i" + std::to_string(i));
+		}
+		return parameters;
+	}
+
+	// the body of the function computing the address of an access, which
+	// is the same for every access it can replace
+	std::string get_function_body(MemoryLocation &location) {
+		Vec<std::string> parameters = get_parameters(location);
+		Vec<std::string> indices(parameters.begin() + 1, parameters.end());
+		return address_to_l3(location.is_tuple_element(), "%tsol", parameters[0], indices, "t")
+			+ "\treturn %tsol\n";
+	}
+
+	struct OutliningCandidate {
+		Vec<MemoryLocation *> locations;
+		Vec<std::string> parameters;
+		int64_t savings = 0;
+	};
+
+	std::string outline_address_computations(Program &program) {
+		Map<std::string, OutliningCandidate> candidates;
+		for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+			std::string prefix = target_arch::new_variable_names(*ir_function);
+			Vec<Uptr<BasicBlock>> &blocks = ir_function->get_blocks();
+			Vec<double> ranks = rank_blocks(blocks);
+			for (int i = 0; i < blocks.size(); ++i) {
+				if (ranks[i] * blocks.size() >= max_outlined_hotness) {
+					continue;
+				}
+				for (const Uptr<Instruction> &inst : blocks[i]->get_inst()) {
+					Opt<MemoryLocation *> location = get_location(*inst);
+					if (!location) {
+						continue;
+					}
+					// constant indices may have shortened the inline code
+					int64_t inline_size = count_instructions((*location)->to_l3(prefix));
+					int64_t call_size = call_overhead + (*location)->get_dimensions().size() + 1;
+					if (inline_size <= call_size) {
+						continue;
+					}
+					OutliningCandidate &candidate = candidates[get_function_body(**location)];
+					candidate.locations.push_back(*location);
+					candidate.parameters = get_parameters(**location);
+					candidate.savings += inline_size - call_size;
+				}
+			}
+		}
+
+		std::string function_prefix = target_arch::new_function_names(program);
+		std::string code;
+		int num_functions = 0;
+		for (const auto &[body, candidate] : candidates) {
+			if (candidate.savings <= count_instructions(body)) {
+				continue;
+			}
+			std::string name = function_prefix + std::to_string(num_functions++);
+			for (MemoryLocation *location : candidate.locations) {
+				location->set_outlined_address(name);
+			}
+			code += "define @" + name + "(";
+			for (int i = 0; i < candidate.parameters.size(); ++i) {
+				code += (i == 0 ? "" : ", ") + candidate.parameters[i];
+			}
+			code += ") {\n" + body + "}\n";
+		}
+		return code;
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::code_gen {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Outlining of array address computations. Every array access expands
+	// into the same sequence of L3 instructions, differing only in the
+	// array and indices it's given. The accesses in blocks ranked colder
+	// than average are grouped by that sequence (with the array and indices
+	// left as parameters), and the accesses of a group that would save
+	// more than the sequence costs as a function call it instead. Hot
+	// accesses are left inline. Returns the L3 code of the functions the
+	// accesses now call.
+	std::string outline_address_computations(Program &program);
+}
@@ -1,4 +1,5 @@
 #include "program.h"
+#include <limits>
 
 namespace IR::program {
 	using namespace std_alias;
@@ -98,6 +99,16 @@ namespace IR::program {
 		};
 		return map[static_cast<int>(op)];
 	}
+	bool is_comparison(Operator op) {
+		switch (op) {
+			case Operator::lt:
+			case Operator::le:
+			case Operator::eq:
+			case Operator::ge:
+			case Operator::gt: return true;
+			default: return false;
+		}
+	}
 	Opt<Operator> flip_operator(Operator op) {
 		switch (op) {
 			// operators that are commutative
@@ -117,7 +128,218 @@ namespace IR::program {
 			default: return {};
 		}
 	}
+	Opt<Operator> negate_operator(Operator op) {
+		switch (op) {
+			case Operator::lt: return Operator::ge;
+			case Operator::le: return Operator::gt;
+			case Operator::gt: return Operator::le;
+			case Operator::ge: return Operator::lt;
+
+			// there is no "not equal" to negate to, and the rest aren't
+			// comparisons
+			default: return {};
+		}
+	}
+	int64_t evaluate_operator(Operator op, int64_t lhs, int64_t rhs) {
+		// arithmetic is done on unsigned values so that overflow wraps around
+		// like it does on the target instead of being undefined
+		uint64_t a = static_cast<uint64_t>(lhs);
+		uint64_t b = static_cast<uint64_t>(rhs);
+		switch (op) {
+			case Operator::lt: return lhs < rhs;
+			case Operator::le: return lhs <= rhs;
+			case Operator::eq: return lhs == rhs;
+			case Operator::ge: return lhs >= rhs;
+			case Operator::gt: return lhs > rhs;
+			case Operator::plus: return static_cast<int64_t>(a + b);
+			case Operator::minus: return static_cast<int64_t>(a - b);
+			case Operator::times: return static_cast<int64_t>(a * b);
+			case Operator::bitwise_and: return lhs & rhs;
+			// the target only looks at the lowest 6 bits of a shift amount
+			case Operator::lshift: return static_cast<int64_t>(a << (b & 63));
+			case Operator::rshift: return lhs >> (b & 63);
+			default:
+				std::cerr << "unknown operator\n";
+				exit(1);
+		}
+	}
+	bool is_right_identity(Operator op, int64_t rhs) {
+		switch (op) {
+			case Operator::plus:
+			case Operator::minus: return rhs == 0;
+			case Operator::times: return rhs == 1;
+			case Operator::bitwise_and: return rhs == -1;
+			case Operator::lshift:
+			case Operator::rshift: return (rhs & 63) == 0;
+			default: return false;
+		}
+	}
+	Opt<int64_t> evaluate_with_rhs(Operator op, int64_t rhs) {
+		const int64_t min = std::numeric_limits<int64_t>::min();
+		const int64_t max = std::numeric_limits<int64_t>::max();
+		switch (op) {
+			case Operator::times:
+			case Operator::bitwise_and: if (rhs == 0) return 0; break;
+			case Operator::lt: if (rhs == min) return 0; break;
+			case Operator::le: if (rhs == max) return 1; break;
+			case Operator::ge: if (rhs == min) return 1; break;
+			case Operator::gt: if (rhs == max) return 0; break;
+			default: break;
+		}
+		return {};
+	}
+	Opt<int64_t> evaluate_with_lhs(Operator op, int64_t lhs) {
+		if (Opt<Operator> flipped = flip_operator(op)) {
+			return evaluate_with_rhs(*flipped, lhs);
+		}
+		switch (op) {
+			case Operator::lshift: if (lhs == 0) return 0; break;
+			case Operator::rshift: if (lhs == 0 || lhs == -1) return lhs; break;
+			default: break;
+		}
+		return {};
+	}
+	Opt<Pair<Operator, int64_t>> reduce_strength(Operator op, int64_t rhs) {
+		// multiplying by a power of two is a shift
+		if (op == Operator::times && rhs > 1 && (rhs & (rhs - 1)) == 0) {
+			int64_t shift = 0;
+			while ((int64_t(1) << shift) != rhs) {
+				shift += 1;
+			}
+			return Pair<Operator, int64_t> { Operator::lshift, shift };
+		}
+		return {};
+	}
 	
+	// Builds the L3 code of a chain of address arithmetic on temporaries,
+	// simplifying each operation with the same identities the optimizer
+	// applies to the IR. Constants are only written once they're needed:
+	// a temporary may be known to hold a constant, or to still need a
+	// constant added to it, which is then reassociated through later
+	// additions and multiplications.
+	class ArithmeticBuilder {
+		std::string code;
+		Map<std::string, int64_t> constants;
+		Map<std::string, int64_t> offsets;
+
+		public:
+
+		// dest <- lhs op rhs
+		void add_operation(const std::string &dest, std::string lhs, Operator op, std::string rhs) {
+			Opt<int64_t> lhs_value = this->get_constant(lhs);
+			Opt<int64_t> rhs_value = this->get_constant(rhs);
+			if (lhs_value && rhs_value) {
+				this->set_constant(dest, evaluate_operator(op, *lhs_value, *rhs_value));
+				return;
+			}
+			Opt<int64_t> result = rhs_value ? evaluate_with_rhs(op, *rhs_value)
+				: lhs_value ? evaluate_with_lhs(op, *lhs_value)
+				: Opt<int64_t> {};
+			if (result) {
+				this->set_constant(dest, *result);
+				return;
+			}
+			// keep the constant on the right
+			if (lhs_value) {
+				if (Opt<Operator> flipped = flip_operator(op)) {
+					std::swap(lhs, rhs);
+					std::swap(lhs_value, rhs_value);
+					op = *flipped;
+				}
+			}
+			if (rhs_value && is_right_identity(op, *rhs_value)) {
+				this->add_copy(dest, lhs);
+				return;
+			}
+			if (op == Operator::minus && rhs_value) {
+				op = Operator::plus;
+				rhs_value = evaluate_operator(Operator::minus, 0, *rhs_value);
+			}
+			auto offset_it = this->offsets.find(lhs);
+			if (lhs == dest && rhs_value && op == Operator::plus) {
+				this->offsets[dest] = evaluate_operator(op, offset_it != this->offsets.end() ? offset_it->second : 0, *rhs_value);
+				return;
+			}
+			// (x + c) * d is x * d + c * d, and x + y + c is (x + y) + c
+			Opt<int64_t> offset;
+			if (lhs == dest && offset_it != this->offsets.end()) {
+				if (op == Operator::plus || (rhs_value && (op == Operator::times || op == Operator::lshift))) {
+					offset = rhs_value ? evaluate_operator(op, offset_it->second, *rhs_value) : offset_it->second;
+					this->offsets.erase(offset_it);
+				}
+			}
+			this->write_offset(lhs);
+			this->write_offset(rhs);
+			if (rhs_value) {
+				if (Opt<Pair<Operator, int64_t>> reduced = reduce_strength(op, *rhs_value)) {
+					op = reduced->first;
+					rhs_value = reduced->second;
+				}
+			}
+			this->add_code(dest, "\t" + dest + " <- " + lhs + " " + op_to_string(op) + " "
+				+ (rhs_value ? std::to_string(*rhs_value) : rhs) + "\n");
+			if (offset && *offset != 0) {
+				this->offsets[dest] = *offset;
+			}
+		}
+
+		// dest <- source
+		void add_copy(const std::string &dest, const std::string &source) {
+			if (Opt<int64_t> value = this->get_constant(source)) {
+				this->set_constant(dest, *value);
+			} else if (dest != source) {
+				this->write_offset(source);
+				this->add_code(dest, "\t" + dest + " <- " + source + "\n");
+			}
+		}
+
+		// adds code which only writes to dest, and only reads temporaries
+		// which hold their value
+		void add_code(const std::string &dest, const std::string &code) {
+			this->constants.erase(dest);
+			this->offsets.erase(dest);
+			this->code += code;
+		}
+
+		// returns the code, with the result written to its temporary
+		std::string get_code(const std::string &result) {
+			auto it = this->constants.find(result);
+			if (it != this->constants.end()) {
+				return this->code + "\t" + result + " <- " + std::to_string(it->second) + "\n";
+			}
+			this->write_offset(result);
+			return this->code;
+		}
+
+		private:
+
+		Opt<int64_t> get_constant(const std::string &operand) const {
+			auto it = this->constants.find(operand);
+			if (it != this->constants.end()) {
+				return it->second;
+			}
+			if (!operand.empty() && (std::isdigit(operand[0]) || operand[0] == '-')) {
+				return std::stoll(operand);
+			}
+			return {};
+		}
+
+		void set_constant(const std::string &dest, int64_t value) {
+			this->offsets.erase(dest);
+			this->constants[dest] = value;
+		}
+
+		// adds the constant a temporary is still missing
+		void write_offset(const std::string &var) {
+			auto it = this->offsets.find(var);
+			if (it != this->offsets.end()) {
+				std::string offset = std::to_string(it->second);
+				this->offsets.erase(it);
+				this->code += "\t" + var + " <- " + var + " + " + offset + "\n";
+			}
+		}
+	};
+
 	template<> std::string ItemRef<Variable>::to_string() const {
 		std::string result = "%" + this->get_ref_name();
 		if (!this->referent_nullable) {
@@ -190,6 +412,9 @@ namespace IR::program {
 		sol += this->rhs->to_l3_expr(prefix);
 		return sol;
 	}
+	Uptr<Expr> BinaryOperation::clone() const {
+		return mkuptr<BinaryOperation>(this->lhs->clone(), this->rhs->clone(), this->op);
+	}
 	std::string FunctionCall::to_string() const {
 		std::string result = "call " + this->callee->to_string() + "(";
 		for (const Uptr<Expr> &argument : this->arguments) {
@@ -219,6 +444,15 @@ namespace IR::program {
 		sol += ")";
 		return sol;
 	}
+	Uptr<Expr> FunctionCall::clone() const {
+		Vec<Uptr<Expr>> arguments;
+		for (const Uptr<Expr> &arg : this->arguments) {
+			arguments.push_back(arg->clone());
+		}
+		Uptr<FunctionCall> call = mkuptr<FunctionCall>(this->callee->clone(), mv(arguments));
+		call->set_tail_call(this->tail_call);
+		return call;
+	}
 	
 	std::string MemoryLocation::to_string() const {
 		std::string sol = "" + this->base->to_string();
@@ -233,44 +467,59 @@ namespace IR::program {
 			expr->bind_to_scope(agg_scope);
 		}
 	}
+	std::string address_to_l3(bool is_tuple, const std::string &accum, const std::string &base, const Vec<std::string> &indices, std::string prefix) {
+		int n = indices.size();
+		ArithmeticBuilder builder;
+		if (is_tuple) {
+			builder.add_operation(accum, indices[0], Operator::plus, "1");
+			builder.add_operation(accum, accum, Operator::times, "8");
+			builder.add_operation(accum, accum, Operator::plus, base);
+			return builder.get_code(accum);
+		}
+		// the offset is accumulated in Horner form, which needs the size of
+		// every dimension but the first
+		for (int i = 1; i < n; i ++) {
+			std::string new_var = make_new_var_name(prefix, i);
+			builder.add_operation(new_var, base, Operator::plus, std::to_string((i + 1) * 8));
+			builder.add_code(new_var, "\t" + new_var + " <- load " + new_var + "\n");
+			builder.add_code(new_var, decode_expr(new_var, new_var, prefix));
+		}
+		builder.add_copy(accum, indices[0]);
+		for (int i = 1; i < n; i++) {
+			builder.add_operation(accum, accum, Operator::times, make_new_var_name(prefix, i));
+			builder.add_operation(accum, accum, Operator::plus, indices[i]);
+		}
+		builder.add_operation(accum, accum, Operator::plus, std::to_string(n + 1));
+		builder.add_operation(accum, accum, Operator::times, "8");
+		builder.add_operation(accum, accum, Operator::plus, base);
+		return builder.get_code(accum);
+	}
+	bool MemoryLocation::is_tuple_element() {
+		return this->base->get_referent().value()->get_type().get_a_type() == A_type::tuple;
+	}
 	std::string MemoryLocation::to_l3(std::string prefix) {
-		int n = this->dimensions.size();
-		if (this->base->get_referent().value()->get_type().get_a_type() == A_type::tuple) {
-			std::string dimension = this->dimensions[0]->to_l3_expr(prefix);
-			std::string sol = "\t%" + prefix + "sol <- 1 + " + dimension + "\n"; 
-			sol += "\t%" + prefix + "sol <- 8 * %" + prefix + "sol\n";
-			sol += "\t%" + prefix + "sol <- %" + prefix + "sol + " + this->base->to_l3_expr(prefix) + "\n";
-			return sol;
-		}
-		std::string base = this->base->to_l3_expr(prefix);
-		std::string sol = "";
-		int counter = 0;
-		for (int i = 0; i < n; i ++) {
-			std::string new_var = make_new_var_name(prefix, counter);
-			sol += "\t" + new_var + " <- " + std::to_string((i + 1) * 8) + " + " + base + "\n";
-			sol += "\t" +  new_var + " <- load " + new_var + "\n";
-			sol += decode_expr(new_var, new_var, prefix);
-			counter++;
-		}
-		std::string accum = make_new_var_name(prefix, counter);
-		sol += "\t" + accum + " <- 0" + "\n";
-		counter++;
-		for (int i = 0; i < n; i++) {
-			std::string curr_row = make_new_var_name(prefix, counter);
-			counter++;
-			sol += "\t" + curr_row + " <- 1\n";
-			for (int j = i + 1; j < n; j++) {
-				std::string multiply = make_new_var_name(prefix, j);
-				sol += "\t" + curr_row + " <- " + curr_row + " * " + multiply + "\n";
+		std::string accum = "%" + prefix + "sol";
+		Vec<std::string> indices;
+		for (const Uptr<Expr> &dim : this->dimensions) {
+			indices.push_back(dim->to_l3_expr(prefix));
+		}
+		if (this->outlined_address) {
+			std::string sol = "\t" + accum + " <- call @" + *this->outlined_address + "(" + this->base->to_l3_expr(prefix);
+			for (const std::string &index : indices) {
+				sol += ", " + index;
 			}
-			sol += "\t" + curr_row + " <- " + curr_row + " * " + this->dimensions[i]->to_l3_expr(prefix) + "\n";
-			sol += "\t" + accum + " <- " + accum + " + " + curr_row + "\n";  
+			return sol + ")\n";
 		}
-		sol += "\t" + accum + " <- " + accum + " + " + std::to_string(n + 1) + "\n";
-		sol += "\t" + accum + " <- " + accum + " * 8\n";
-		sol += "\t" + accum + " <- " + accum + " + " + base + "\n"; 
-		sol += "\t%" + prefix + "sol <- " + accum + "\n";
-		return sol;
+		return address_to_l3(this->is_tuple_element(), accum, this->base->to_l3_expr(prefix), indices, prefix);
+	}
+	Uptr<MemoryLocation> MemoryLocation::clone() const {
+		Vec<Uptr<Expr>> dimensions;
+		for (const Uptr<Expr> &dim : this->dimensions) {
+			dimensions.push_back(dim->clone());
+		}
+		Uptr<MemoryLocation> location = mkuptr<MemoryLocation>(mkuptr<ItemRef<Variable>>(*this->base), mv(dimensions));
+		location->set_outlined_address(this->outlined_address);
+		return location;
 	}
 	std::string ArrayDeclaration::to_string() const {
 		std::string sol = "new Array (";
@@ -280,6 +529,13 @@ namespace IR::program {
 		sol += ")";
 		return sol;
 	}
+	Uptr<ArrayDeclaration> ArrayDeclaration::clone() const {
+		Vec<Uptr<Expr>> args;
+		for (const Uptr<Expr> &arg : this->args) {
+			args.push_back(arg->clone());
+		}
+		return mkuptr<ArrayDeclaration>(mv(args));
+	}
 	void ArrayDeclaration::bind_to_scope(AggregateScope &agg_scope) {
 		for (const auto &arg : this->args) {
 			arg->bind_to_scope(agg_scope);
@@ -292,6 +548,12 @@ namespace IR::program {
 		}
 		return sol;
 	}
+	Uptr<Length> Length::clone() const {
+		if (this->dimension) {
+			return mkuptr<Length>(mkuptr<ItemRef<Variable>>(*this->var), *this->dimension);
+		}
+		return mkuptr<Length>(mkuptr<ItemRef<Variable>>(*this->var));
+	}
 	void Length::bind_to_scope(AggregateScope &agg_scope) {
 		this->var->bind_to_scope(agg_scope);
 	}
@@ -311,8 +573,33 @@ namespace IR::program {
 		}
 		this->source->bind_to_scope(agg_scope);
 	}
+	Opt<ItemRef<Variable> *> InstructionAssignment::get_dest() {
+		if (this->maybe_dest.has_value()) {
+			return this->maybe_dest.value().get();
+		}
+		return {};
+	}
+	Vec<Uptr<Expr> *> InstructionAssignment::get_operands() {
+		if (BinaryOperation *bin_op = dynamic_cast<BinaryOperation *>(this->source.get())) {
+			return { &bin_op->get_lhs(), &bin_op->get_rhs() };
+		}
+		if (FunctionCall *call = dynamic_cast<FunctionCall *>(this->source.get())) {
+			Vec<Uptr<Expr> *> sol = { &call->get_callee() };
+			for (Uptr<Expr> &arg : call->get_arguments()) {
+				sol.push_back(&arg);
+			}
+			return sol;
+		}
+		return { &this->source };
+	}
 	std::string InstructionAssignment::to_l3_inst(std::string prefix) {
-		std::string sol = "\t";
+		std::string sol = "";
+		FunctionCall *call = dynamic_cast<FunctionCall *>(this->source.get());
+		if (call && call->is_tail_call()) {
+			// marks the call for the L3 compiler, which may reuse the frame
+			sol += "\t// tail call\n";
+		}
+		sol += "\t";
 		if (this->maybe_dest.has_value()) {
 			sol += this->maybe_dest.value()->to_l3_expr(prefix);
 			sol += " <- ";
@@ -320,6 +607,12 @@ namespace IR::program {
 		sol += this->source->to_l3_expr(prefix);
 		return sol + "\n";
 	}
+	Uptr<Instruction> InstructionAssignment::clone() const {
+		if (this->maybe_dest) {
+			return mkuptr<InstructionAssignment>(mkuptr<ItemRef<Variable>>(**this->maybe_dest), this->source->clone());
+		}
+		return mkuptr<InstructionAssignment>(this->source->clone());
+	}
 	std::string InstructionDeclaration::to_string() const {
 		std::string sol =  this->var->get_type().to_string() + " ";
 		sol += this->var->to_string();
@@ -333,6 +626,10 @@ namespace IR::program {
 	std::string InstructionDeclaration::to_l3_inst(std::string prefix) {
 		return "";
 	}
+	Uptr<Instruction> InstructionDeclaration::clone() const {
+		// a declaration owns its variable, so the copy declares a new one
+		return mkuptr<InstructionDeclaration>(mkuptr<Variable>(this->var->get_name(), this->var->get_type()));
+	}
 	std::string InstructionStore::to_string() const {
 		return this->dest->to_string() + " <- " + this->source->to_string();
 	}
@@ -340,12 +637,23 @@ namespace IR::program {
 		this->dest->bind_to_scope(agg_scope);
 		this->source->bind_to_scope(agg_scope);
 	}
+	Vec<Uptr<Expr> *> InstructionStore::get_operands() {
+		Vec<Uptr<Expr> *> sol;
+		for (Uptr<Expr> &dim : this->dest->get_dimensions()) {
+			sol.push_back(&dim);
+		}
+		sol.push_back(&this->source);
+		return sol;
+	}
 	std::string InstructionStore::to_l3_inst(std::string prefix) {
 		std::string sol = "";
 		sol += this->dest->to_l3(prefix);
 		sol += "\tstore %" + prefix + "sol <- " + this->source->to_l3_expr(prefix) + "\n";
 		return sol;
 	}
+	Uptr<Instruction> InstructionStore::clone() const {
+		return mkuptr<InstructionStore>(this->dest->clone(), this->source->clone());
+	}
 	std::string InstructionLoad::to_string() const {
 		return this->dest->to_string() + " <- " + this-> source->to_string();
 	}
@@ -353,12 +661,22 @@ namespace IR::program {
 		this->dest->bind_to_scope(agg_scope);
 		this->source->bind_to_scope(agg_scope);
 	}
+	Vec<Uptr<Expr> *> InstructionLoad::get_operands() {
+		Vec<Uptr<Expr> *> sol;
+		for (Uptr<Expr> &dim : this->source->get_dimensions()) {
+			sol.push_back(&dim);
+		}
+		return sol;
+	}
 	std::string InstructionLoad::to_l3_inst(std::string prefix) {
 		std::string sol = "";
 		sol += this->source->to_l3(prefix);
 		sol += "\t" + this->dest->to_l3_expr(prefix) + " <- load %" + prefix + "sol\n";
 		return sol;
 	}
+	Uptr<Instruction> InstructionLoad::clone() const {
+		return mkuptr<InstructionLoad>(mkuptr<ItemRef<Variable>>(*this->dest), this->source->clone());
+	}
 	std::string InstructionInitializeArray::to_string() const {
 		std::string sol = this->dest->to_string();
 		sol += " <- ";
@@ -367,8 +685,16 @@ namespace IR::program {
 	}
 	void InstructionInitializeArray::bind_to_scope(AggregateScope &agg_scope) {
 		this->dest->bind_to_scope(agg_scope);
+		this->newArray->bind_to_scope(agg_scope);
 		this->dest->get_referent().value()->set_args(this->newArray->get_args());
 	}
+	Vec<Uptr<Expr> *> InstructionInitializeArray::get_operands() {
+		Vec<Uptr<Expr> *> sol;
+		for (Uptr<Expr> &arg : this->newArray->get_args()) {
+			sol.push_back(&arg);
+		}
+		return sol;
+	}
 	std::string InstructionInitializeArray::to_l3_inst(std::string prefix) {
 		Vec<Uptr<Expr>> &args = this->newArray->get_args();
 		if (this->dest->get_referent().value()->get_type().get_a_type() == A_type::tuple) {
@@ -377,28 +703,40 @@ namespace IR::program {
 			sol += "\t" + this->dest->to_l3_expr(prefix) + " <- call allocate(" + arg->to_l3_expr(prefix) + ", 1)\n";
 			return sol;
 		}
-		int counter = 1;
+		// each decoded dimension and each address is dead after its one
+		// use, so a single temporary holds them all
 		std::string base = "%" + prefix + std::to_string(0);
-		std::string sol = "\t" + base + " <- 1\n";
-		for(Uptr<Expr> &arg: args){
-			std::string new_var = "%" + prefix + std::to_string(counter);
-			sol += decode_expr(new_var, arg->to_l3_expr(prefix), prefix);
-			sol += "\t" + base + " <- " + base + " * " + new_var + "\n";
-			counter++;
+		std::string new_var = "%" + prefix + std::to_string(1);
+		ArithmeticBuilder builder;
+		// the size is computed doubled, so that it only needs 1 added to be
+		// encoded. the first dimension is encoded as 2n + 1, so it's
+		// doubled by subtracting 1 instead of being decoded
+		std::string first_dim = args[0]->to_l3_expr(prefix);
+		int64_t header_size = 2 * args.size() + 1;
+		if (args.size() == 1) {
+			builder.add_operation(base, first_dim, Operator::plus, std::to_string(header_size - 1));
+		} else {
+			builder.add_operation(base, first_dim, Operator::minus, "1");
+			for (int i = 1; i < args.size(); i++) {
+				// decode the dimension
+				builder.add_operation(new_var, args[i]->to_l3_expr(prefix), Operator::rshift, "1");
+				builder.add_operation(base, base, Operator::times, new_var);
+			}
+			builder.add_operation(base, base, Operator::plus, std::to_string(header_size));
 		}
-		sol += "\t" + base + " <- " + base + " + " + std::to_string(args.size()) + "\n";
-		sol += encode_expr(base, base, prefix);
+		std::string sol = builder.get_code(base);
 		sol += "\t" + this->dest->to_l3_expr(prefix) + " <- call allocate(" + base + ", 1)\n";
 		int index = 1;
 		for(Uptr<Expr> &arg: args){
-			std::string new_var = "%" + prefix + std::to_string(counter);
 			sol += "\t" + new_var + " <- " + this->dest->to_l3_expr(prefix) + " + " + std::to_string(index * 8) + "\n";
 			sol += "\tstore " + new_var + " <- " + arg->to_l3_expr(prefix) + "\n";
-			counter++;
 			index++;
 		}
 		return sol;
 	}
+	Uptr<Instruction> InstructionInitializeArray::clone() const {
+		return mkuptr<InstructionInitializeArray>(mkuptr<ItemRef<Variable>>(*this->dest), this->newArray->clone());
+	}
 	std::string InstructionLength::to_string() const {
 		return this->dest->to_string() + " <- " + this->source->to_string();
 	}
@@ -417,11 +755,16 @@ namespace IR::program {
 		}
 		dim += 1;
 		std::string new_var = "%" + prefix + "0";
-		std::string sol = "\t" + new_var + " <- " + std::to_string(dim) + " * 8\n";
-		sol += "\t" + new_var + " <- " + this->source->get_var().to_l3_expr(prefix) + " + " + new_var + "\n";
+		ArithmeticBuilder builder;
+		builder.add_operation(new_var, std::to_string(dim), Operator::times, "8");
+		builder.add_operation(new_var, this->source->get_var().to_l3_expr(prefix), Operator::plus, new_var);
+		std::string sol = builder.get_code(new_var);
 		sol += "\t" + this->dest->to_l3_expr(prefix) + " <- load " + new_var + "\n";
 		return sol;
 	}
+	Uptr<Instruction> InstructionLength::clone() const {
+		return mkuptr<InstructionLength>(mkuptr<ItemRef<Variable>>(*this->dest), this->source->clone());
+	}
 
 	void TerminatorBranchOne::bind_to_scope(AggregateScope &agg_scope) {
 		this->bb_ref->bind_to_scope(agg_scope);
@@ -452,6 +795,9 @@ namespace IR::program {
 		}
 		return "";
 	}
+	Uptr<Terminator> TerminatorBranchOne::clone() const {
+		return mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(*this->bb_ref));
+	}
 	void TerminatorBranchTwo::bind_to_scope(AggregateScope &agg_scope) {
 		this->condition->bind_to_scope(agg_scope);
 		this->branchTrue->bind_to_scope(agg_scope);
@@ -503,6 +849,13 @@ namespace IR::program {
 			return sol;
 		}
 	}
+	Uptr<Terminator> TerminatorBranchTwo::clone() const {
+		return mkuptr<TerminatorBranchTwo>(
+			this->condition->clone(),
+			mkuptr<ItemRef<BasicBlock>>(*this->branchTrue),
+			mkuptr<ItemRef<BasicBlock>>(*this->branchFalse)
+		);
+	}
 	void TerminatorReturnVar::bind_to_scope(AggregateScope &agg_scope) {
 		this->ret_expr->bind_to_scope(agg_scope);
 	}
@@ -585,6 +938,16 @@ namespace IR::program {
 		this->parameter_vars.push_back(var_ptr.get());
 		this->vars.emplace_back(mv(var_ptr));
 	}
+	Uptr<Variable> IRFunction::remove_parameter(int index) {
+		Variable *var = this->parameter_vars[index];
+		this->parameter_vars.erase(this->parameter_vars.begin() + index);
+		auto var_it = std::find_if(this->vars.begin(), this->vars.end(), [&](const Uptr<Variable> &v) {
+			return v.get() == var;
+		});
+		Uptr<Variable> result = mv(*var_it);
+		this->vars.erase(var_it);
+		return result;
+	}
 	std::string IRFunction::to_string() const {
 		std::string result = "define @" + this->name + "(";
 		for (const Variable *var : this->parameter_vars) {
@@ -46,6 +46,8 @@ namespace IR::program {
 		virtual std::string to_string() const = 0;
 		virtual void bind_to_scope(AggregateScope &agg_scope) = 0;
 		virtual std::string to_l3_expr(std::string prefix) = 0;
+		// returns a deep copy, with refs bound to the same items
+		virtual Uptr<Expr> clone() const = 0;
 	};
 	struct Trace {
 	    Vec<BasicBlock *> block_sequence; 
@@ -61,9 +63,14 @@ namespace IR::program {
 			free_name { mv(free_name) },
 			referent_nullable { nullptr }
 		{}
+		ItemRef(Item *referent) :
+			free_name { referent->get_name() },
+			referent_nullable { referent }
+		{}
 		virtual void bind_to_scope(AggregateScope &agg_scope) override;
 		virtual std::string to_string() const override;
 		virtual std::string to_l3_expr(std::string prefix) override;
+		virtual Uptr<Expr> clone() const override { return mkuptr<ItemRef>(*this); }
 		Opt<Item *> get_referent() const {
 			if (this->referent_nullable) {
 				return this->referent_nullable;
@@ -92,6 +99,7 @@ namespace IR::program {
 		virtual std::string to_string() const override {return std::to_string(this->value);};
 		virtual void bind_to_scope(AggregateScope &agg_scope) {return;}
 		virtual std::string to_l3_expr(std::string prefix) {return std::to_string(this->value); }
+		virtual Uptr<Expr> clone() const override { return mkuptr<NumberLiteral>(this->value); }
 	};
 
 	enum struct Operator {
@@ -109,7 +117,19 @@ namespace IR::program {
 	};
 	Operator str_to_op(std::string str);
 	std::string op_to_string(Operator op);
+	bool is_comparison(Operator op);
 	Opt<Operator> flip_operator(Operator op);
+	// returns the comparison that is true exactly when the given one isn't
+	Opt<Operator> negate_operator(Operator op);
+	int64_t evaluate_operator(Operator op, int64_t lhs, int64_t rhs);
+	// whether `x op rhs` is x for every x
+	bool is_right_identity(Operator op, int64_t rhs);
+	// returns what `x op rhs` is for every x, if that doesn't depend on x
+	Opt<int64_t> evaluate_with_rhs(Operator op, int64_t rhs);
+	// returns what `lhs op x` is for every x, if that doesn't depend on x
+	Opt<int64_t> evaluate_with_lhs(Operator op, int64_t lhs);
+	// returns a cheaper operator and right operand computing `x op rhs`
+	Opt<Pair<Operator, int64_t>> reduce_strength(Operator op, int64_t rhs);
 
 	class BinaryOperation : public Expr {
 		Uptr<Expr> lhs;
@@ -123,26 +143,43 @@ namespace IR::program {
 			rhs { mv(rhs) },
 			op { op }
 		{}
+		Uptr<Expr> &get_lhs() { return this->lhs; }
+		Uptr<Expr> &get_rhs() { return this->rhs; }
+		Operator get_operator() const { return this->op; }
 		virtual void bind_to_scope(AggregateScope &agg_scope) override;
 		virtual std::string to_string() const override;
 		virtual std::string to_l3_expr(std::string prefix) override;
+		virtual Uptr<Expr> clone() const override;
 	};
 	class FunctionCall : public Expr {
 		Uptr<Expr> callee;
 		Vec<Uptr<Expr>> arguments;
+		bool tail_call;
 
 		public:
 
 		FunctionCall(Uptr<Expr> &&callee, Vec<Uptr<Expr>> &&arguments) :
-			callee { mv(callee) }, arguments { mv(arguments) }
+			callee { mv(callee) }, arguments { mv(arguments) }, tail_call { false }
 		{}
+		Uptr<Expr> &get_callee() { return this->callee; }
+		Vec<Uptr<Expr>> &get_arguments() { return this->arguments; }
+		// a tail call is immediately followed by returning its result, so
+		// the caller's frame is no longer needed during the call
+		bool is_tail_call() const { return this->tail_call; }
+		void set_tail_call(bool tail_call) { this->tail_call = tail_call; }
 		virtual void bind_to_scope(AggregateScope &agg_scope) override;
 		virtual std::string to_string() const override;
 		virtual std::string to_l3_expr(std::string prefix) override;
+		virtual Uptr<Expr> clone() const override;
 	};
+	// Returns the L3 code computing the address of an element into accum,
+	// given the L3 expressions for the array (or tuple) and the indices.
+	std::string address_to_l3(bool is_tuple, const std::string &accum, const std::string &base, const Vec<std::string> &indices, std::string prefix);
+
 	class MemoryLocation{
 		Uptr<ItemRef<Variable>> base;
 		Vec<Uptr<Expr>> dimensions;
+		Opt<std::string> outlined_address;
 
 		public:
 
@@ -153,7 +190,13 @@ namespace IR::program {
 		void bind_to_scope(AggregateScope &agg_scope);
 		std::string to_string() const;
 		std::string to_l3(std::string prefix);
+		ItemRef<Variable> &get_base() { return *this->base; }
 		Vec<Uptr<Expr>> &get_dimensions() {return this->dimensions; }
+		bool is_tuple_element();
+		// the L3 function the address is computed by, instead of inline
+		const Opt<std::string> &get_outlined_address() const { return this->outlined_address; }
+		void set_outlined_address(Opt<std::string> function_name) { this->outlined_address = mv(function_name); }
+		Uptr<MemoryLocation> clone() const;
 	};
 	class ArrayDeclaration {
 		Vec<Uptr<Expr>> args;
@@ -165,6 +208,7 @@ namespace IR::program {
 		std::string to_string() const;
 		std::string to_l3(std::string prefix);
 		Vec<Uptr<Expr>> &get_args(){return this->args;}
+		Uptr<ArrayDeclaration> clone() const;
 
 	};
 	class Length {
@@ -178,6 +222,7 @@ namespace IR::program {
 		void bind_to_scope(AggregateScope &agg_scope);
 		ItemRef<Variable> &get_var() const {return *this->var; }
 		Opt<int64_t> get_dim() const {return this->dimension; }
+		Uptr<Length> clone() const;
 		std::string to_string() const;
 		std::string to_l3(std::string prefix);
 	};
@@ -207,6 +252,16 @@ namespace IR::program {
 		virtual void bind_to_scope(AggregateScope &agg_scope) = 0;
 		virtual void resolver(AggregateScope &agg_scope){}
 		virtual std::string to_l3_inst(std::string prefix) = 0;
+		// returns a deep copy, with refs bound to the same items
+		virtual Uptr<Instruction> clone() const = 0;
+
+		// the variable written by this instruction, if any
+		virtual Opt<ItemRef<Variable> *> get_dest() { return {}; }
+		// the slots of every value (T or S) read by this instruction, which
+		// optimizations may replace with equivalent values
+		virtual Vec<Uptr<Expr> *> get_operands() { return {}; }
+		// the array or tuple whose memory this instruction reads or writes
+		virtual Opt<ItemRef<Variable> *> get_accessed_array() { return {}; }
 	};
 	class InstructionAssignment: public Instruction {
 		Opt<Uptr<ItemRef<Variable>>> maybe_dest;
@@ -218,9 +273,13 @@ namespace IR::program {
 		InstructionAssignment(Uptr<ItemRef<Variable>> &&destination, Uptr<Expr> &&source) :
 			maybe_dest { mv(destination) }, source { mv(source) }
 		{}
+		Uptr<Expr> &get_source() { return this->source; }
 		virtual void bind_to_scope(AggregateScope &agg_scope) override;
 		virtual std::string to_string() const override;
 		virtual std::string to_l3_inst(std::string prefix) override;
+		virtual Uptr<Instruction> clone() const override;
+		virtual Opt<ItemRef<Variable> *> get_dest() override;
+		virtual Vec<Uptr<Expr> *> get_operands() override;
 	};
 	class InstructionDeclaration: public Instruction {
 		Uptr<Variable> var;
@@ -232,6 +291,7 @@ namespace IR::program {
 		virtual std::string to_string() const override;
 		virtual void resolver(AggregateScope &agg_scope) override;
 		virtual std::string to_l3_inst(std::string prefix) override;
+		virtual Uptr<Instruction> clone() const override;
 	};
 	class InstructionStore: public Instruction {
 		Uptr<MemoryLocation> dest; 
@@ -242,9 +302,14 @@ namespace IR::program {
 		InstructionStore(Uptr<MemoryLocation> dest, Uptr<Expr> source): 
 			dest {mv(dest)}, source {mv(source)}
 		{}
+		MemoryLocation &get_location() { return *this->dest; }
+		Uptr<Expr> &get_source() { return this->source; }
 		virtual void bind_to_scope(AggregateScope &agg_scope) override;
 		virtual std::string to_string() const override;
 		virtual std::string to_l3_inst(std::string prefix) override;
+		virtual Uptr<Instruction> clone() const override;
+		virtual Vec<Uptr<Expr> *> get_operands() override;
+		virtual Opt<ItemRef<Variable> *> get_accessed_array() override { return &this->dest->get_base(); }
 	};
 	class InstructionLoad: public Instruction {
 		Uptr<ItemRef<Variable>> dest;
@@ -255,9 +320,14 @@ namespace IR::program {
 		InstructionLoad(Uptr<ItemRef<Variable>> dest, Uptr<MemoryLocation> source): 
 			dest {mv(dest)}, source {mv(source)}
 		{}
+		MemoryLocation &get_location() { return *this->source; }
 		virtual void bind_to_scope(AggregateScope &agg_scope) override;
 		virtual std::string to_string() const override;
 		virtual std::string to_l3_inst(std::string prefix) override;
+		virtual Uptr<Instruction> clone() const override;
+		virtual Opt<ItemRef<Variable> *> get_dest() override { return this->dest.get(); }
+		virtual Vec<Uptr<Expr> *> get_operands() override;
+		virtual Opt<ItemRef<Variable> *> get_accessed_array() override { return &this->source->get_base(); }
 	};
 	class InstructionLength: public Instruction {
 		Uptr<ItemRef<Variable>> dest;
@@ -268,9 +338,13 @@ namespace IR::program {
 		InstructionLength(Uptr<ItemRef<Variable>> dest, Uptr<Length> source): 
 			dest {mv(dest)}, source {mv(source)}
 		{}
+		Length &get_length() { return *this->source; }
 		virtual void bind_to_scope(AggregateScope &agg_scope) override;
 		virtual std::string to_string() const override;
 		virtual std::string to_l3_inst(std::string prefix) override;
+		virtual Uptr<Instruction> clone() const override;
+		virtual Opt<ItemRef<Variable> *> get_dest() override { return this->dest.get(); }
+		virtual Opt<ItemRef<Variable> *> get_accessed_array() override { return &this->source->get_var(); }
 	};
 	class InstructionInitializeArray: public Instruction {
 		Uptr<ItemRef<Variable>> dest;
@@ -281,9 +355,13 @@ namespace IR::program {
 		InstructionInitializeArray(Uptr<ItemRef<Variable>> dest, Uptr<ArrayDeclaration> newArray): 
 			dest {mv(dest)}, newArray {mv(newArray)}
 		{}
+		ArrayDeclaration &get_declaration() { return *this->newArray; }
 		virtual void bind_to_scope(AggregateScope &agg_scope) override;
 		virtual std::string to_string() const override;
 		virtual std::string to_l3_inst(std::string prefix) override;
+		virtual Uptr<Instruction> clone() const override;
+		virtual Opt<ItemRef<Variable> *> get_dest() override { return this->dest.get(); }
+		virtual Vec<Uptr<Expr> *> get_operands() override;
 	};
 
 	class Terminator {
@@ -294,6 +372,11 @@ namespace IR::program {
 		virtual Vec<Pair<BasicBlock *, double>> get_successor() = 0;
 		virtual std::string to_string() const = 0;
 		virtual std::string to_l3_terminator(std::string prefix, Trace &my_trace, BasicBlock *my_bb) = 0;
+		// returns a deep copy, with refs bound to the same items
+		virtual Uptr<Terminator> clone() const = 0;
+		virtual Vec<Uptr<Expr> *> get_operands() { return {}; }
+		// the labels this terminator can branch to
+		virtual Vec<ItemRef<BasicBlock> *> get_targets() { return {}; }
 	};
 	class TerminatorBranchOne : public Terminator{
 		Uptr<ItemRef<BasicBlock>> bb_ref;
@@ -304,6 +387,8 @@ namespace IR::program {
 		virtual std::string to_string() const;
 		virtual Vec<Pair<BasicBlock *, double>> get_successor();
 		virtual std::string to_l3_terminator(std::string prefix, Trace &my_trace, BasicBlock *my_bb) override;
+		virtual Uptr<Terminator> clone() const override;
+		virtual Vec<ItemRef<BasicBlock> *> get_targets() override { return { this->bb_ref.get() }; }
 	};
 	class TerminatorBranchTwo : public Terminator{
 		Uptr<Expr> condition;
@@ -321,10 +406,15 @@ namespace IR::program {
 			branchTrue (mv(branchTrue)),
 			branchFalse {mv(branchFalse)}
 		{}
+		ItemRef<BasicBlock> &get_branch_true() { return *this->branchTrue; }
+		ItemRef<BasicBlock> &get_branch_false() { return *this->branchFalse; }
 		virtual void bind_to_scope(AggregateScope &agg_scope);
 		virtual Vec<Pair<BasicBlock *, double>> get_successor();
 		virtual std::string to_string() const;
 		virtual std::string to_l3_terminator(std::string prefix, Trace &my_trace, BasicBlock *my_bb) override;
+		virtual Uptr<Terminator> clone() const override;
+		virtual Vec<Uptr<Expr> *> get_operands() override { return { &this->condition }; }
+		virtual Vec<ItemRef<BasicBlock> *> get_targets() override { return { this->branchTrue.get(), this->branchFalse.get() }; }
 	};
 	class TerminatorReturnVoid : public Terminator {
 		public:
@@ -332,6 +422,7 @@ namespace IR::program {
 		virtual Vec<Pair<BasicBlock *, double>> get_successor() { return {}; }
 		virtual std::string to_string() const {return "return\n"; }
 		virtual std::string to_l3_terminator(std::string prefix, Trace &my_trace, BasicBlock *my_bb) {return "\treturn\n";};
+		virtual Uptr<Terminator> clone() const override { return mkuptr<TerminatorReturnVoid>(); }
 	};
 	class TerminatorReturnVar : public Terminator {
 		Uptr<Expr> ret_expr;
@@ -343,6 +434,8 @@ namespace IR::program {
 		virtual std::string to_string() const;
 		virtual std::string to_l3_terminator(std::string prefix, Trace &my_trace, BasicBlock *my_bb) override;
 		virtual Vec<Pair<BasicBlock *, double>> get_successor() { return {};}
+		virtual Uptr<Terminator> clone() const override { return mkuptr<TerminatorReturnVar>(this->ret_expr->clone()); }
+		virtual Vec<Uptr<Expr> *> get_operands() override { return { &this->ret_expr }; }
 	};
 
 	class BasicBlock {
@@ -369,6 +462,10 @@ namespace IR::program {
 		Vec<Uptr<Instruction>> &get_inst() { return this->inst; }
 		Uptr<Terminator> &get_terminator() { return this->te; }
 		void set_successors(Vec<Pair<BasicBlock *, double>> succ) {this->successors = mv(succ); }
+		void set_terminator(Uptr<Terminator> &&te) {
+			this->te = mv(te);
+			this->successors = this->te->get_successor();
+		}
 		void set_name(std::string new_name) {this->name = mv(new_name); }
 		void bind_to_scope(AggregateScope &agg_scope);
 
@@ -550,7 +647,11 @@ namespace IR::program {
 		{}
 		virtual const std::string &get_name() const override { return this->name; }
 		const Vec<Uptr<BasicBlock>> &get_blocks() const { return this->blocks; }
+		Vec<Uptr<BasicBlock>> &get_blocks() { return this->blocks; }
 		const Vec<Variable *> &get_parameter_vars() const { return this->parameter_vars; }
+		Type &get_ret_type() { return this->ret_type; }
+		// removes a parameter, handing its variable over to the caller
+		Uptr<Variable> remove_parameter(int index);
 		AggregateScope &get_scope() { return this->agg_scope; }
 		virtual std::string to_string() const override;
 
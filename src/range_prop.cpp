@@ -0,0 +1,54 @@
+#include "range_prop.h"
+#include "value_range.h"
+#include "cfg.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	bool fold_decided_comparisons(IRFunction &ir_function) {
+		Map<BasicBlock *, RangeMap> entry_ranges = compute_value_ranges(ir_function);
+		bool changed = false;
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			auto ranges_it = entry_ranges.find(bb.get());
+			if (ranges_it == entry_ranges.end()) {
+				continue;
+			}
+			RangeMap &ranges = ranges_it->second;
+			for (Uptr<Instruction> &inst : bb->get_inst()) {
+				InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(inst.get());
+				BinaryOperation *bin_op = assignment ? dynamic_cast<BinaryOperation *>(assignment->get_source().get()) : nullptr;
+				if (bin_op && is_comparison(bin_op->get_operator())) {
+					Opt<bool> outcome = decide_comparison(
+						bin_op->get_operator(),
+						get_range(bin_op->get_lhs(), ranges),
+						get_range(bin_op->get_rhs(), ranges)
+					);
+					if (outcome) {
+						assignment->get_source() = mkuptr<NumberLiteral>(*outcome);
+						changed = true;
+					}
+				}
+				transfer_ranges(*inst, ranges);
+			}
+
+			// a branch is decided if only one of its edges can be taken
+			if (!dynamic_cast<TerminatorBranchTwo *>(bb->get_terminator().get())) {
+				continue;
+			}
+			Vec<Pair<BasicBlock *, double>> successors = bb->get_terminator()->get_successor();
+			Range condition = get_range(*bb->get_terminator()->get_operands()[0], ranges);
+			Opt<BasicBlock *> target;
+			if (!condition.contains(0)) {
+				target = successors[0].first;
+			} else if (condition == Range::constant(0)) {
+				target = successors[1].first;
+			}
+			if (target) {
+				bb->set_terminator(mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(*target)));
+				changed = true;
+			}
+		}
+		changed |= cfg::remove_unreachable_blocks(ir_function);
+		return changed;
+	}
+}
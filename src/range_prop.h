@@ -0,0 +1,14 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Value range propagation. Comparisons whose outcome the ranges of
+	// their operands decide are replaced by that outcome, as are the
+	// conditions of branches, and blocks no consistent path can reach are
+	// removed. Returns whether the function was changed.
+	bool fold_decided_comparisons(IRFunction &ir_function);
+}
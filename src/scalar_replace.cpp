@@ -0,0 +1,194 @@
+#include "scalar_replace.h"
+#include "analysis.h"
+#include "cfg.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// the most elements an aggregate may have to be replaced
+	const int64_t max_replaced_elements = 8;
+
+	// the arguments every allocation of an aggregate is made with, as
+	// given to `new` (encoded)
+	using AllocationArgs = Vec<int64_t>;
+
+	bool is_int64_scalar(Variable *var) {
+		Type &type = var->get_type();
+		return type.get_a_type() == A_type::int64 && type.get_num_dimensions() == 0;
+	}
+
+	// returns the decoded dimensions of an allocation, if they are small
+	// enough to replace
+	Opt<Vec<int64_t>> get_dimensions(const AllocationArgs &args) {
+		Vec<int64_t> dims;
+		int64_t count = 1;
+		for (int64_t arg : args) {
+			if (arg < 1 || arg % 2 == 0) {
+				return {};
+			}
+			dims.push_back(arg >> 1);
+			if (__builtin_mul_overflow(count, dims.back(), &count) || count > max_replaced_elements) {
+				return {};
+			}
+		}
+		return dims;
+	}
+
+	// returns which element a location refers to, counting in row-major
+	// order, if its indices are numbers within the dimensions
+	Opt<int64_t> get_element(MemoryLocation &location, const Vec<int64_t> &dims) {
+		Vec<Uptr<Expr>> &indices = location.get_dimensions();
+		if (indices.size() != dims.size()) {
+			return {};
+		}
+		int64_t element = 0;
+		for (int k = 0; k < dims.size(); ++k) {
+			Opt<int64_t> index = get_number(indices[k]);
+			if (!index || *index < 0 || *index >= dims[k]) {
+				return {};
+			}
+			element = element * dims[k] + *index;
+		}
+		return element;
+	}
+
+	// returns the value a length query on an aggregate gives, which is
+	// encoded
+	int64_t get_length(const AllocationArgs &args, const Vec<int64_t> &dims, Opt<int64_t> dimension, bool is_tuple) {
+		if (dimension) {
+			return args[*dimension];
+		}
+		if (is_tuple) {
+			return args[0];
+		}
+		// the number of words after the length, dimensions included
+		int64_t words = 1;
+		for (int64_t dim : dims) {
+			words *= dim;
+		}
+		words += dims.size();
+		return (words << 1) + 1;
+	}
+
+	// Returns the aggregates that can be replaced, along with the arguments
+	// they are allocated with.
+	Map<Variable *, AllocationArgs> find_replaceable_aggregates(IRFunction &ir_function) {
+		Set<Variable *> local_arrays = get_non_escaping_arrays(ir_function);
+		Map<Variable *, AllocationArgs> result;
+		Set<Variable *> rejected;
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				InstructionInitializeArray *allocation = dynamic_cast<InstructionInitializeArray *>(inst.get());
+				if (!allocation || !local_arrays.count(*get_def(*allocation))) {
+					continue;
+				}
+				Variable *array = *get_def(*allocation);
+				AllocationArgs args;
+				for (const Uptr<Expr> &arg : allocation->get_declaration().get_args()) {
+					if (Opt<int64_t> number = get_number(arg)) {
+						args.push_back(*number);
+					} else {
+						rejected.insert(array);
+					}
+				}
+				auto [it, inserted] = result.emplace(array, args);
+				if (!get_dimensions(args) || (!inserted && it->second != args)) {
+					rejected.insert(array);
+				}
+			}
+		}
+
+		// every access must touch a known element, with an int64 value
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				Opt<ItemRef<Variable> *> accessed = inst->get_accessed_array();
+				auto it = accessed ? result.find(*(*accessed)->get_referent()) : result.end();
+				if (it == result.end()) {
+					continue;
+				}
+				Vec<int64_t> dims = get_dimensions(it->second).value_or(Vec<int64_t> {});
+				bool is_replaceable = true;
+				if (InstructionLoad *load = dynamic_cast<InstructionLoad *>(inst.get())) {
+					is_replaceable = get_element(load->get_location(), dims) && is_int64_scalar(*get_def(*load));
+				} else if (InstructionStore *store = dynamic_cast<InstructionStore *>(inst.get())) {
+					Opt<Variable *> source = get_variable(store->get_source());
+					is_replaceable = get_element(store->get_location(), dims)
+						&& (get_number(store->get_source()) || (source && is_int64_scalar(*source)));
+				} else if (InstructionLength *length = dynamic_cast<InstructionLength *>(inst.get())) {
+					Opt<int64_t> dimension = length->get_length().get_dim();
+					bool is_tuple = it->first->get_type().get_a_type() == A_type::tuple;
+					is_replaceable = !dimension || (!is_tuple && *dimension >= 0 && *dimension < dims.size());
+				}
+				if (!is_replaceable) {
+					rejected.insert(it->first);
+				}
+			}
+		}
+		for (Variable *array : rejected) {
+			result.erase(array);
+		}
+		return result;
+	}
+
+	bool replace_aggregates(IRFunction &ir_function) {
+		Map<Variable *, AllocationArgs> aggregates = find_replaceable_aggregates(ir_function);
+		if (aggregates.empty()) {
+			return false;
+		}
+		Map<Variable *, Vec<Variable *>> elements;
+		for (const auto &[array, args] : aggregates) {
+			Vec<Variable *> &vars = elements[array];
+			int64_t count = 1;
+			Vec<int64_t> dims = *get_dimensions(args);
+			for (int64_t dim : dims) {
+				count *= dim;
+			}
+			for (int64_t i = 0; i < count; ++i) {
+				vars.push_back(cfg::declare_variable(
+					ir_function,
+					array->get_name() + "_" + std::to_string(i),
+					Type(A_type::int64, 0)
+				));
+			}
+		}
+
+		auto make_copy = [](Variable *dest, Uptr<Expr> source) {
+			return mkuptr<InstructionAssignment>(mkuptr<ItemRef<Variable>>(dest), mv(source));
+		};
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			Vec<Uptr<Instruction>> new_insts;
+			for (Uptr<Instruction> &inst : bb->get_inst()) {
+				Opt<ItemRef<Variable> *> accessed = inst->get_accessed_array();
+				Opt<Variable *> def = get_def(*inst);
+				Variable *array = accessed ? *(*accessed)->get_referent() : def.value_or(nullptr);
+				auto it = aggregates.find(array);
+				if (it == aggregates.end()) {
+					new_insts.push_back(mv(inst));
+					continue;
+				}
+				const AllocationArgs &args = it->second;
+				Vec<int64_t> dims = *get_dimensions(args);
+				const Vec<Variable *> &vars = elements.at(array);
+				if (dynamic_cast<InstructionInitializeArray *>(inst.get())) {
+					for (Variable *var : vars) {
+						new_insts.push_back(make_copy(var, mkuptr<NumberLiteral>(1)));
+					}
+				} else if (InstructionLoad *load = dynamic_cast<InstructionLoad *>(inst.get())) {
+					Variable *element = vars[*get_element(load->get_location(), dims)];
+					new_insts.push_back(make_copy(*get_def(*load), mkuptr<ItemRef<Variable>>(element)));
+				} else if (InstructionStore *store = dynamic_cast<InstructionStore *>(inst.get())) {
+					Variable *element = vars[*get_element(store->get_location(), dims)];
+					new_insts.push_back(make_copy(element, mv(store->get_source())));
+				} else if (InstructionLength *length = dynamic_cast<InstructionLength *>(inst.get())) {
+					bool is_tuple = array->get_type().get_a_type() == A_type::tuple;
+					int64_t value = get_length(args, dims, length->get_length().get_dim(), is_tuple);
+					new_insts.push_back(make_copy(*get_def(*length), mkuptr<NumberLiteral>(value)));
+				} else {
+					new_insts.push_back(mv(inst));
+				}
+			}
+			bb->get_inst() = mv(new_insts);
+		}
+		return true;
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Scalar replacement of aggregates. A small array or tuple that never
+	// escapes, whose every allocation has the same constant dimensions and
+	// whose every access uses constant indices within them, is replaced by
+	// one variable per element. Allocating it sets each variable to 1 (an
+	// encoded 0), and loads, stores and length queries become copies. An
+	// aggregate holding anything but int64 values, or accessed with any
+	// other index, is left in memory. Returns whether the function was
+	// changed.
+	bool replace_aggregates(IRFunction &ir_function);
+}
@@ -0,0 +1,168 @@
+#include "simplify_cfg.h"
+#include "analysis.h"
+#include "cfg.h"
+#include <algorithm>
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// blocks with only declarations don't compute anything
+	bool has_no_effect(BasicBlock &bb) {
+		for (const Uptr<Instruction> &inst : bb.get_inst()) {
+			if (!dynamic_cast<InstructionDeclaration *>(inst.get())) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// turns a two-way branch which can only go one way into a jump
+	bool fold_branch(BasicBlock &bb) {
+		TerminatorBranchTwo *branch = dynamic_cast<TerminatorBranchTwo *>(bb.get_terminator().get());
+		if (!branch) {
+			return false;
+		}
+		BasicBlock *true_target = *branch->get_branch_true().get_referent();
+		BasicBlock *false_target = *branch->get_branch_false().get_referent();
+		BasicBlock *target;
+		if (true_target == false_target) {
+			target = true_target;
+		} else if (Opt<int64_t> condition = get_number(*branch->get_operands()[0])) {
+			target = *condition != 0 ? true_target : false_target;
+		} else {
+			return false;
+		}
+		bb.set_terminator(mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(target)));
+		return true;
+	}
+
+	// Returns the value the variable has at the end of the block when
+	// control leaves it through the given target slot, if that is known
+	Opt<bool> get_known_condition(BasicBlock &bb, ItemRef<BasicBlock> *edge, Variable *condition) {
+		// the block may have branched on it itself
+		TerminatorBranchTwo *branch = dynamic_cast<TerminatorBranchTwo *>(bb.get_terminator().get());
+		if (branch && get_variable(*branch->get_operands()[0]) == condition) {
+			return edge == &branch->get_branch_true();
+		}
+		Vec<Uptr<Instruction>> &insts = bb.get_inst();
+		for (auto it = insts.rbegin(); it != insts.rend(); ++it) {
+			if (get_def(**it) != condition) {
+				continue;
+			}
+			InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(it->get());
+			if (Opt<int64_t> value = assignment ? get_number(assignment->get_source()) : Opt<int64_t> {}) {
+				return *value != 0;
+			}
+			return {};
+		}
+		return {};
+	}
+
+	// redirects the edges into a block which has no effect and just jumps
+	// (or branches on something known) to where it would have gone
+	bool thread_jumps(IRFunction &ir_function) {
+		bool changed = false;
+		Map<BasicBlock *, Vec<BasicBlock *>> predecessors = cfg::get_predecessors(ir_function);
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			BasicBlock *bb = block.get();
+			if (!has_no_effect(*bb)) {
+				continue;
+			}
+			Terminator *te = bb->get_terminator().get();
+			TerminatorBranchTwo *branch = dynamic_cast<TerminatorBranchTwo *>(te);
+			Opt<Variable *> condition = branch ? get_variable(*branch->get_operands()[0]) : Opt<Variable *> {};
+			if (!dynamic_cast<TerminatorBranchOne *>(te) && !condition) {
+				continue;
+			}
+			for (BasicBlock *pred : predecessors.at(bb)) {
+				if (pred == bb) {
+					continue;
+				}
+				bool redirected = false;
+				for (ItemRef<BasicBlock> *edge : pred->get_terminator()->get_targets()) {
+					if (*edge->get_referent() != bb) {
+						continue;
+					}
+					BasicBlock *target;
+					if (!branch) {
+						target = *te->get_targets()[0]->get_referent();
+					} else if (Opt<bool> value = get_known_condition(*pred, edge, *condition)) {
+						target = *(*value ? branch->get_branch_true() : branch->get_branch_false()).get_referent();
+					} else {
+						continue;
+					}
+					if (target != bb) {
+						edge->bind(target);
+						redirected = true;
+					}
+				}
+				if (redirected) {
+					pred->set_successors(pred->get_terminator()->get_successor());
+					fold_branch(*pred);
+					changed = true;
+				}
+			}
+			if (changed) {
+				// the predecessors are stale now
+				return true;
+			}
+		}
+		return changed;
+	}
+
+	// appends each block that is only reached by a jump from a single
+	// block to that block
+	bool merge_blocks(IRFunction &ir_function) {
+		bool changed = false;
+		Map<BasicBlock *, Vec<BasicBlock *>> predecessors = cfg::get_predecessors(ir_function);
+		Vec<Uptr<BasicBlock>> &blocks = ir_function.get_blocks();
+		Set<BasicBlock *> merged;
+		for (const Uptr<BasicBlock> &block : blocks) {
+			BasicBlock *bb = block.get();
+			if (merged.find(bb) != merged.end()) {
+				continue;
+			}
+			while (dynamic_cast<TerminatorBranchOne *>(bb->get_terminator().get())) {
+				BasicBlock *succ = *bb->get_terminator()->get_targets()[0]->get_referent();
+				if (succ == bb || succ == blocks[0].get() || predecessors.at(succ).size() != 1) {
+					break;
+				}
+				Vec<Uptr<Instruction>> &insts = bb->get_inst();
+				for (Uptr<Instruction> &inst : succ->get_inst()) {
+					insts.push_back(mv(inst));
+				}
+				succ->get_inst().clear();
+				bb->set_terminator(mv(succ->get_terminator()));
+				// the blocks succ jumped to are now jumped to by bb
+				for (const auto &[succ_succ, weight] : bb->get_successors()) {
+					for (BasicBlock *&pred : predecessors.at(succ_succ)) {
+						if (pred == succ) {
+							pred = bb;
+						}
+					}
+				}
+				merged.insert(succ);
+				changed = true;
+			}
+		}
+		blocks.erase(std::remove_if(blocks.begin(), blocks.end(), [&](const Uptr<BasicBlock> &block) {
+			return merged.find(block.get()) != merged.end();
+		}), blocks.end());
+		return changed;
+	}
+
+	bool simplify_cfg(IRFunction &ir_function) {
+		bool changed = false;
+		for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+			changed |= fold_branch(*block);
+		}
+		bool progress = true;
+		while (progress) {
+			progress = cfg::remove_unreachable_blocks(ir_function);
+			progress |= thread_jumps(ir_function);
+			progress |= merge_blocks(ir_function);
+			changed |= progress;
+		}
+		return changed;
+	}
+}
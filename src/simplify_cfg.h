@@ -0,0 +1,16 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Control flow graph simplification. Branches are threaded through
+	// blocks that only jump elsewhere, and through blocks that only branch
+	// on a condition which is already known on the incoming edge. Blocks
+	// that are always entered from a single jump are merged into the block
+	// jumping to them, and unreachable blocks are removed. Returns whether
+	// the function was changed.
+	bool simplify_cfg(IRFunction &ir_function);
+}
@@ -0,0 +1,213 @@
+#include "tagged_ints.h"
+#include "analysis.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// what is known about how the variables of a block represent their
+	// values, as long as the variables involved still hold them
+	struct Representations {
+		// the variables known to hold an encoded value
+		Set<Variable *> encoded;
+		// maps a variable holding a value n to one holding 2n + 1
+		Map<Variable *, Variable *> encoded_forms;
+		// the sums and differences the variables hold
+		Map<Variable *, BinaryOperation *> operations;
+
+		// forgets everything that stops holding once var is written to
+		void forget(Variable *var) {
+			this->encoded.erase(var);
+			this->encoded_forms.erase(var);
+			for (auto it = this->encoded_forms.begin(); it != this->encoded_forms.end();) {
+				if (it->second == var) {
+					it = this->encoded_forms.erase(it);
+				} else {
+					++it;
+				}
+			}
+			this->operations.erase(var);
+			for (auto it = this->operations.begin(); it != this->operations.end();) {
+				BinaryOperation &bin_op = *it->second;
+				if (get_variable(bin_op.get_lhs()) == var || get_variable(bin_op.get_rhs()) == var) {
+					it = this->operations.erase(it);
+				} else {
+					++it;
+				}
+			}
+		}
+
+		// returns the variable whose encoded form var holds, if known
+		Opt<Variable *> get_decoded_form(Variable *var) const {
+			for (const auto &[decoded, encoded] : this->encoded_forms) {
+				if (encoded == var) {
+					return decoded;
+				}
+			}
+			return {};
+		}
+
+		// returns an expression holding the encoded form of a value, if
+		// there is one
+		Opt<Uptr<Expr>> get_encoded_form(const Uptr<Expr> &expr) const {
+			if (Opt<int64_t> number = get_number(expr)) {
+				return mkuptr<NumberLiteral>(evaluate_operator(
+					Operator::plus,
+					evaluate_operator(Operator::lshift, *number, 1),
+					1
+				));
+			}
+			if (Opt<Variable *> var = get_variable(expr)) {
+				auto it = this->encoded_forms.find(*var);
+				if (it != this->encoded_forms.end()) {
+					return mkuptr<ItemRef<Variable>>(it->second);
+				}
+			}
+			return {};
+		}
+	};
+
+	bool is_decoding(BinaryOperation &bin_op) {
+		return bin_op.get_operator() == Operator::rshift && get_number(bin_op.get_rhs()) == 1;
+	}
+
+	// returns whether the two instructions are `x <- y << 1` and
+	// `x <- x + 1`, encoding y into x
+	bool is_encoding(Instruction &shift, Instruction &increment) {
+		InstructionAssignment *shift_assignment = dynamic_cast<InstructionAssignment *>(&shift);
+		InstructionAssignment *increment_assignment = dynamic_cast<InstructionAssignment *>(&increment);
+		if (!shift_assignment || !increment_assignment) {
+			return false;
+		}
+		BinaryOperation *shift_op = dynamic_cast<BinaryOperation *>(shift_assignment->get_source().get());
+		BinaryOperation *increment_op = dynamic_cast<BinaryOperation *>(increment_assignment->get_source().get());
+		if (!shift_op || !increment_op) {
+			return false;
+		}
+		Opt<Variable *> dest = get_def(shift);
+		return shift_op->get_operator() == Operator::lshift
+			&& get_number(shift_op->get_rhs()) == 1
+			&& increment_op->get_operator() == Operator::plus
+			&& get_number(increment_op->get_rhs()) == 1
+			&& get_variable(increment_op->get_lhs()) == dest
+			&& get_def(increment) == dest;
+	}
+
+	bool eliminate_tag_conversions(IRFunction &ir_function) {
+		bool changed = false;
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			Vec<Uptr<Instruction>> &insts = bb->get_inst();
+			Representations representations;
+			for (int64_t i = 0; i < insts.size(); i++) {
+				Opt<Variable *> def = get_def(*insts[i]);
+				if (!def) {
+					continue;
+				}
+				InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(insts[i].get());
+				if (!assignment) {
+					representations.forget(*def);
+					// lengths are always encoded
+					if (dynamic_cast<InstructionLength *>(insts[i].get())) {
+						representations.encoded.insert(*def);
+					}
+					continue;
+				}
+				Uptr<Expr> &source = assignment->get_source();
+				BinaryOperation *bin_op = dynamic_cast<BinaryOperation *>(source.get());
+				Opt<Variable *> operand = bin_op ? get_variable(bin_op->get_lhs()) : get_variable(source);
+
+				if (bin_op && operand && is_decoding(*bin_op)) {
+					Variable *encoded = *operand;
+					if (Opt<Variable *> decoded = representations.get_decoded_form(encoded)) {
+						changed = true;
+						if (*decoded == *def) {
+							insts.erase(insts.begin() + i);
+							i--;
+							continue;
+						}
+						source = mkuptr<ItemRef<Variable>>(*decoded);
+					}
+					bool was_encoded = representations.encoded.count(encoded);
+					representations.forget(*def);
+					if (was_encoded && encoded != *def) {
+						representations.encoded_forms.insert_or_assign(*def, encoded);
+					}
+					continue;
+				}
+
+				if (i + 1 < insts.size() && is_encoding(*insts[i], *insts[i + 1])) {
+					Opt<Variable *> encoded_form;
+					if (operand) {
+						auto it = representations.encoded_forms.find(*operand);
+						if (it != representations.encoded_forms.end()) {
+							encoded_form = it->second;
+						}
+					}
+					auto operation_it = operand ? representations.operations.find(*operand) : representations.operations.end();
+					if (encoded_form) {
+						// the value is already encoded somewhere
+						changed = true;
+						if (*encoded_form == *def) {
+							insts.erase(insts.begin() + i, insts.begin() + i + 2);
+							i--;
+							continue;
+						}
+						source = mkuptr<ItemRef<Variable>>(*encoded_form);
+						insts.erase(insts.begin() + i + 1);
+					} else if (operation_it != representations.operations.end()) {
+						// 2(a + b) + 1 = (2a + 1) + (2b + 1) - 1, and
+						// 2(a - b) + 1 = (2a + 1) - (2b + 1) + 1
+						BinaryOperation &operation = *operation_it->second;
+						Opt<Uptr<Expr>> lhs = representations.get_encoded_form(operation.get_lhs());
+						Opt<Uptr<Expr>> rhs = representations.get_encoded_form(operation.get_rhs());
+						if (lhs && rhs) {
+							changed = true;
+							Operator op = operation.get_operator();
+							source = mkuptr<BinaryOperation>(mv(*lhs), mv(*rhs), op);
+							if (op == Operator::plus) {
+								BinaryOperation &increment = dynamic_cast<BinaryOperation &>(
+									*dynamic_cast<InstructionAssignment &>(*insts[i + 1]).get_source()
+								);
+								increment.get_rhs() = mkuptr<NumberLiteral>(-1);
+							}
+						}
+						i++;
+					} else {
+						i++;
+					}
+					representations.forget(*def);
+					representations.encoded.insert(*def);
+					if (operand && *operand != *def) {
+						representations.encoded_forms.insert_or_assign(*operand, *def);
+					}
+					continue;
+				}
+
+				// a copy represents its value the same way
+				bool copies_encoded = !bin_op && operand && representations.encoded.count(*operand);
+				Opt<Uptr<Expr>> copied_form = !bin_op && operand ? representations.get_encoded_form(source) : Opt<Uptr<Expr>> {};
+				Opt<int64_t> number = get_number(source);
+				// a copy of a variable to itself keeps what is known about it,
+				// but an update in place like `%k <- %k + 1` does not
+				if (!bin_op && operand == def) {
+					continue;
+				}
+				representations.forget(*def);
+				if (copies_encoded || (number && (*number & 1))) {
+					representations.encoded.insert(*def);
+				}
+				if (copied_form) {
+					Opt<Variable *> encoded = get_variable(*copied_form);
+					if (*encoded != *def) {
+						representations.encoded_forms.insert_or_assign(*def, *encoded);
+					}
+				}
+				if (bin_op && (bin_op->get_operator() == Operator::plus || bin_op->get_operator() == Operator::minus)
+					&& get_variable(bin_op->get_lhs()) != def && get_variable(bin_op->get_rhs()) != def)
+				{
+					representations.operations.emplace(*def, bin_op);
+				}
+			}
+		}
+		return changed;
+	}
+}
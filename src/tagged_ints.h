@@ -0,0 +1,18 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Integers are encoded as 2n + 1 whenever they're stored, printed or
+	// used as a length, so values get decoded (`x >> 1`) and encoded
+	// (`x << 1` then `x + 1`) all the time. This tracks which variables of a
+	// block hold the encoded form of which others, and removes decodings of
+	// encoded values, encodings of decoded values, and turns the encoding
+	// of a sum or difference of decoded values into the same operation on
+	// their encoded forms (`enc(a) + enc(b) - 1`). Returns whether the
+	// function was changed.
+	bool eliminate_tag_conversions(IRFunction &ir_function);
+}
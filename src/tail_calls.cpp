@@ -0,0 +1,135 @@
+#include "tail_calls.h"
+#include "analysis.h"
+#include "cfg.h"
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// returns whether the block ends in a call whose result is returned
+	bool ends_in_tail_call(BasicBlock &bb) {
+		Vec<Uptr<Instruction>> &insts = bb.get_inst();
+		if (insts.empty() || !get_called_function(*insts.back())) {
+			return false;
+		}
+		Terminator *te = bb.get_terminator().get();
+		if (dynamic_cast<TerminatorReturnVoid *>(te)) {
+			return true;
+		}
+		if (dynamic_cast<TerminatorReturnVar *>(te)) {
+			Opt<Variable *> result = get_def(*insts.back());
+			return result && get_variable(*te->get_operands()[0]) == result;
+		}
+		return false;
+	}
+
+	class TailRecursionEliminator {
+		IRFunction &ir_function;
+		Opt<BasicBlock *> loop_header;
+		Set<std::string> variable_names;
+		// the variables holding the new arguments while the parameters are
+		// reassigned, since the arguments may read the parameters
+		Vec<Variable *> argument_vars;
+
+		public:
+
+		explicit TailRecursionEliminator(IRFunction &ir_function) : ir_function { ir_function } {
+			for (Variable *var : ir_function.get_parameter_vars()) {
+				this->variable_names.insert(var->get_name());
+			}
+			for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+				for (const Uptr<Instruction> &inst : bb->get_inst()) {
+					if (InstructionDeclaration *decl = dynamic_cast<InstructionDeclaration *>(inst.get())) {
+						this->variable_names.insert((*decl->get_referent())->get_name());
+					}
+				}
+			}
+		}
+
+		// replaces the self call at the end of the block with a jump to the
+		// start of the function
+		void eliminate(BasicBlock &bb) {
+			BasicBlock *header = this->get_loop_header();
+			Vec<Uptr<Instruction>> &insts = bb.get_inst();
+			Vec<Uptr<Expr>> &arguments = (*get_call(*insts.back()))->get_arguments();
+			const Vec<Variable *> &parameters = this->ir_function.get_parameter_vars();
+			Vec<Uptr<Instruction>> new_insts;
+			for (int i = 0; i < parameters.size(); ++i) {
+				new_insts.push_back(mkuptr<InstructionAssignment>(
+					mkuptr<ItemRef<Variable>>(this->get_argument_var(i)),
+					mv(arguments[i])
+				));
+			}
+			for (int i = 0; i < parameters.size(); ++i) {
+				new_insts.push_back(mkuptr<InstructionAssignment>(
+					mkuptr<ItemRef<Variable>>(parameters[i]),
+					mkuptr<ItemRef<Variable>>(this->get_argument_var(i))
+				));
+			}
+			insts.pop_back();
+			for (Uptr<Instruction> &inst : new_insts) {
+				insts.push_back(mv(inst));
+			}
+			bb.set_terminator(mkuptr<TerminatorBranchOne>(mkuptr<ItemRef<BasicBlock>>(header)));
+		}
+
+		private:
+
+		// the old entry block becomes the loop header, behind a new entry
+		BasicBlock *get_loop_header() {
+			if (!this->loop_header) {
+				BasicBlock *old_entry = this->ir_function.get_blocks()[0].get();
+				cfg::insert_block_before(this->ir_function, old_entry, old_entry->get_name() + "_tail_entry");
+				this->loop_header = old_entry;
+			}
+			return *this->loop_header;
+		}
+
+		Variable *get_argument_var(int index) {
+			while (this->argument_vars.size() <= index) {
+				Variable *param = this->ir_function.get_parameter_vars()[this->argument_vars.size()];
+				std::string name = param->get_name() + "_next";
+				for (int counter = 0; this->variable_names.find(name) != this->variable_names.end(); ++counter) {
+					name = param->get_name() + "_next" + std::to_string(counter);
+				}
+				this->variable_names.insert(name);
+				Uptr<Variable> var = mkuptr<Variable>(name, param->get_type());
+				this->argument_vars.push_back(var.get());
+				Vec<Uptr<Instruction>> &entry_insts = this->ir_function.get_blocks()[0]->get_inst();
+				entry_insts.insert(entry_insts.begin(), mkuptr<InstructionDeclaration>(mv(var)));
+			}
+			return this->argument_vars[index];
+		}
+	};
+
+	bool eliminate_tail_calls(IRFunction &ir_function) {
+		bool changed = false;
+		TailRecursionEliminator eliminator(ir_function);
+		// the eliminator may add a block, so collect them first
+		Vec<BasicBlock *> blocks;
+		for (const Uptr<BasicBlock> &bb : ir_function.get_blocks()) {
+			blocks.push_back(bb.get());
+		}
+		for (BasicBlock *bb : blocks) {
+			// tail positions may have changed since the last time
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				if (Opt<FunctionCall *> call = get_call(*inst)) {
+					(*call)->set_tail_call(false);
+				}
+			}
+			if (!ends_in_tail_call(*bb)) {
+				continue;
+			}
+			Instruction &call_inst = *bb->get_inst().back();
+			FunctionCall *call = *get_call(call_inst);
+			if (*get_called_function(call_inst) == &ir_function
+				&& call->get_arguments().size() == ir_function.get_parameter_vars().size())
+			{
+				eliminator.eliminate(*bb);
+				changed = true;
+			} else {
+				call->set_tail_call(true);
+			}
+		}
+		return changed;
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Tail call elimination. A call that is immediately followed by
+	// returning its result (or returning nothing) is in tail position. If
+	// the function calls itself there, the call becomes a reassignment of
+	// the parameters and a jump back to the start of the function, so the
+	// recursion runs as a loop. Tail calls to other IR functions are marked
+	// so that the generated L3 can reuse the frame. Returns whether the
+	// function was changed.
+	bool eliminate_tail_calls(IRFunction &ir_function);
+}
@@ -3,8 +3,47 @@
 
 namespace IR::code_gen::target_arch {
 
-	std::string new_variable_names(IRFunction &fun, BasicBlock& bb){
-		return fun.get_name() + bb.get_name();
+	std::string new_variable_names(IRFunction &fun){
+		Vec<std::string> names;
+		for (Variable *var : fun.get_parameter_vars()) {
+			names.push_back(var->get_name());
+		}
+		for (const Uptr<BasicBlock> &bb : fun.get_blocks()) {
+			for (const Uptr<Instruction> &inst : bb->get_inst()) {
+				if (InstructionDeclaration *decl = dynamic_cast<InstructionDeclaration *>(inst.get())) {
+					names.push_back(decl->get_referent().value()->get_name());
+				}
+			}
+		}
+		std::string prefix = "t";
+		bool clashes = true;
+		while (clashes) {
+			clashes = false;
+			for (const std::string &name : names) {
+				if (name.compare(0, prefix.size(), prefix) == 0) {
+					clashes = true;
+					prefix += "_";
+					break;
+				}
+			}
+		}
+		return prefix;
+	}
+
+	std::string new_function_names(Program &program) {
+		std::string prefix = "address";
+		bool clashes = true;
+		while (clashes) {
+			clashes = false;
+			for (const Uptr<IRFunction> &ir_function : program.get_ir_functions()) {
+				if (ir_function->get_name().compare(0, prefix.size(), prefix) == 0) {
+					clashes = true;
+					prefix += "_";
+					break;
+				}
+			}
+		}
+		return prefix;
 	}
 
     void mangle_label_names(Program &program) {
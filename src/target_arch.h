@@ -12,7 +12,16 @@ namespace IR::code_gen::target_arch {
 
 	std::string decode_expr(Variable &decode_to, Expr &target, std::string &prefix);
 
-	std::string new_variable_names(IRFunction &fun, BasicBlock& bb);
+	// Returns the prefix for the temporaries the generated code of a
+	// function needs. A temporary is only ever live inside the code for a
+	// single instruction or terminator, so the whole function shares one
+	// small pool of them. The prefix is chosen so that they can't clash
+	// with the function's own variables.
+	std::string new_variable_names(IRFunction &fun);
+
+	// Returns the prefix for the names of the functions the generator adds
+	// to a program, chosen so that they can't clash with its own functions.
+	std::string new_function_names(Program &program);
 
     // Modifies a program so that its label names are all globally unique
 	// and always start with an underscore (so that non-underscore names can
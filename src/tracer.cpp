@@ -136,11 +136,15 @@ namespace IR::tracer {
         return a.weight < b.weight;
     }
 
-    Vec<Trace> trace_cfg(const Vec<Uptr<BasicBlock>> &blocks) {
-        // calculate how popular each block is its "rank"
+    Vec<double> rank_blocks(const Vec<Uptr<BasicBlock>> &blocks) {
         Vec<Vec<double>> transition_matrix = make_link_matrix(blocks);
         incorporate_damping_factor(transition_matrix, 0.85);
-        Vec<double> block_ranks = find_steady_state(mv(transition_matrix));
+        return find_steady_state(mv(transition_matrix));
+    }
+
+    Vec<Trace> trace_cfg(const Vec<Uptr<BasicBlock>> &blocks) {
+        // calculate how popular each block is its "rank"
+        Vec<double> block_ranks = rank_blocks(blocks);
 
         // store all the edges by their weight
         std::priority_queue<BbEdge> edges;
@@ -13,5 +13,10 @@ namespace IR::tracer {
     using namespace IR::program;
 
 
+    // Returns how popular each block is (its "rank"), in the same order as
+    // the blocks. The ranks add up to 1, so a block of average popularity
+    // has a rank of 1 / blocks.size().
+    Vec<double> rank_blocks(const Vec<Uptr<BasicBlock>> &blocks);
+
     Vec<Trace> trace_cfg(const Vec<Uptr<BasicBlock>> &blocks);
 }
\ No newline at end of file
@@ -0,0 +1,338 @@
+#include "value_numbering.h"
+#include "analysis.h"
+#include "cfg.h"
+#include <unordered_map>
+
+namespace IR::optimizer {
+	using namespace IR::analysis;
+
+	// identifies a computation by what it computes and the value numbers of
+	// its operands
+	struct ExprKey {
+		// an Operator, or one of the kinds below
+		int kind;
+		Vec<int64_t> operands;
+
+		static const int load_kind = -1;
+		static const int length_kind = -2;
+
+		bool operator==(const ExprKey &other) const {
+			return this->kind == other.kind && this->operands == other.operands;
+		}
+	};
+	struct ExprKeyHash {
+		size_t operator()(const ExprKey &key) const {
+			size_t hash = std::hash<int>()(key.kind);
+			for (int64_t operand : key.operands) {
+				hash ^= std::hash<int64_t>()(operand) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+			}
+			return hash;
+		}
+	};
+
+	// a value number and a variable that held it when it was computed
+	struct NumberedValue {
+		int number;
+		Opt<Variable *> holder;
+	};
+
+	// what is known at a point in the dominator tree
+	struct ValueTable {
+		Map<Variable *, int> var_numbers;
+		std::unordered_map<ExprKey, NumberedValue, ExprKeyHash> exprs;
+		// the version of each memory alias class, which changes every time
+		// the memory might be written to. non-escaping arrays have their own
+		// class; every other array is in the class keyed by nullptr
+		Map<Variable *, int> memory_versions;
+	};
+
+	// what changes on some path from the idom of a block to the block
+	struct RegionEffects {
+		Set<Variable *> defs;
+		Set<Variable *> clobbered_memory;
+	};
+
+	class ValueNumberer {
+		int next_number;
+		Map<int64_t, int> constant_numbers;
+		Map<int, int64_t> number_constants;
+		Map<std::string, int> name_numbers;
+		Set<Variable *> local_arrays;
+		Map<BasicBlock *, RegionEffects> region_effects;
+		const cfg::DominatorTree &dominators;
+		const call_graph::SummaryMap &summaries;
+		bool changed;
+
+		public:
+
+		ValueNumberer(IRFunction &ir_function, const cfg::DominatorTree &dominators, const call_graph::SummaryMap &summaries) :
+			next_number { 0 },
+			local_arrays { get_non_escaping_arrays(ir_function) },
+			dominators { dominators },
+			summaries { summaries },
+			changed { false }
+		{
+			this->find_region_effects(ir_function);
+		}
+
+		bool run(IRFunction &ir_function) {
+			BasicBlock *entry_block = ir_function.get_blocks()[0].get();
+			ValueTable table;
+			this->visit(*entry_block, mv(table));
+			return this->changed;
+		}
+
+		private:
+
+		int new_number() {
+			return this->next_number++;
+		}
+
+		Variable *get_memory_class(Variable *array) {
+			if (this->local_arrays.find(array) != this->local_arrays.end()) {
+				return array;
+			}
+			return nullptr;
+		}
+
+		void clobber_memory(ValueTable &table, Variable *memory_class) {
+			table.memory_versions[memory_class] = this->new_number();
+		}
+
+		int get_var_number(ValueTable &table, Variable *var) {
+			auto it = table.var_numbers.find(var);
+			if (it != table.var_numbers.end()) {
+				return it->second;
+			}
+			// the value the variable had on entry to the function
+			int number = this->new_number();
+			table.var_numbers[var] = number;
+			return number;
+		}
+
+		int get_memory_version(ValueTable &table, Variable *memory_class) {
+			auto it = table.memory_versions.find(memory_class);
+			if (it != table.memory_versions.end()) {
+				return it->second;
+			}
+			int version = this->new_number();
+			table.memory_versions[memory_class] = version;
+			return version;
+		}
+
+		int get_constant_number(int64_t value) {
+			auto it = this->constant_numbers.find(value);
+			if (it != this->constant_numbers.end()) {
+				return it->second;
+			}
+			int number = this->new_number();
+			this->constant_numbers[value] = number;
+			this->number_constants[number] = value;
+			return number;
+		}
+
+		int get_number(ValueTable &table, const Uptr<Expr> &expr) {
+			if (Opt<int64_t> value = analysis::get_number(expr)) {
+				return this->get_constant_number(*value);
+			}
+			if (Opt<Variable *> var = get_variable(expr)) {
+				return this->get_var_number(table, *var);
+			}
+			// labels and functions are identified by their name
+			std::string name = expr->to_string();
+			auto it = this->name_numbers.find(name);
+			if (it != this->name_numbers.end()) {
+				return it->second;
+			}
+			int number = this->new_number();
+			this->name_numbers[name] = number;
+			return number;
+		}
+
+		ExprKey make_operation_key(ValueTable &table, BinaryOperation &bin_op) {
+			Operator op = bin_op.get_operator();
+			int64_t lhs = this->get_number(table, bin_op.get_lhs());
+			int64_t rhs = this->get_number(table, bin_op.get_rhs());
+			// put the operands in a canonical order, so that "a < b" and
+			// "b > a" (or "a + b" and "b + a") are recognized as the same
+			if (lhs > rhs) {
+				if (Opt<Operator> flipped = flip_operator(op)) {
+					op = *flipped;
+					std::swap(lhs, rhs);
+				}
+			}
+			return ExprKey { static_cast<int>(op), { lhs, rhs } };
+		}
+
+		ExprKey make_load_key(ValueTable &table, MemoryLocation &location) {
+			Variable *array = *location.get_base().get_referent();
+			ExprKey key { ExprKey::load_kind, {} };
+			key.operands.push_back(this->get_var_number(table, array));
+			key.operands.push_back(this->get_memory_version(table, this->get_memory_class(array)));
+			for (const Uptr<Expr> &dim : location.get_dimensions()) {
+				key.operands.push_back(this->get_number(table, dim));
+			}
+			return key;
+		}
+
+		ExprKey make_length_key(ValueTable &table, Length &length) {
+			Variable *array = *length.get_var().get_referent();
+			Opt<int64_t> dim = length.get_dim();
+			return ExprKey { ExprKey::length_kind, { this->get_var_number(table, array), dim ? *dim : -1 } };
+		}
+
+		// Returns a value equivalent to the given value number, if one is
+		// available at this point
+		Opt<Uptr<Expr>> find_equivalent(ValueTable &table, const NumberedValue &value) {
+			auto constant_it = this->number_constants.find(value.number);
+			if (constant_it != this->number_constants.end()) {
+				return mkuptr<NumberLiteral>(constant_it->second);
+			}
+			if (value.holder && this->get_var_number(table, *value.holder) == value.number) {
+				return mkuptr<ItemRef<Variable>>(*value.holder);
+			}
+			return {};
+		}
+
+		// Gives the instruction's destination the value number of the
+		// computation identified by key. If an equivalent value is already
+		// available, the instruction is replaced with a copy of it (or
+		// removed, if it was a copy of the destination to itself).
+		void number_computation(ValueTable &table, Uptr<Instruction> &inst, Variable *dest, ExprKey key) {
+			auto it = table.exprs.find(key);
+			if (it != table.exprs.end()) {
+				if (Opt<Uptr<Expr>> equivalent = this->find_equivalent(table, it->second)) {
+					if (get_variable(*equivalent) == dest) {
+						inst.reset();
+					} else {
+						inst = mkuptr<InstructionAssignment>(mkuptr<ItemRef<Variable>>(dest), mv(*equivalent));
+					}
+					table.var_numbers[dest] = it->second.number;
+					this->changed = true;
+					return;
+				}
+			}
+			int number = this->new_number();
+			table.var_numbers[dest] = number;
+			table.exprs.insert_or_assign(key, NumberedValue { number, dest });
+		}
+
+		void number_instruction(ValueTable &table, Uptr<Instruction> &inst) {
+			Instruction *raw_inst = inst.get();
+			if (InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(raw_inst)) {
+				Uptr<Expr> &source = assignment->get_source();
+				Opt<Variable *> dest = get_def(*raw_inst);
+				if (BinaryOperation *bin_op = dynamic_cast<BinaryOperation *>(source.get())) {
+					this->number_computation(table, inst, *dest, this->make_operation_key(table, *bin_op));
+				} else if (FunctionCall *call = dynamic_cast<FunctionCall *>(source.get())) {
+					// a call can write to any memory except our own arrays
+					if (call_graph::get_call_summary(*call, this->summaries).writes_memory) {
+						this->clobber_memory(table, nullptr);
+					}
+					if (dest) {
+						table.var_numbers[*dest] = this->new_number();
+					}
+				} else {
+					table.var_numbers[*dest] = this->get_number(table, source);
+				}
+			} else if (InstructionLoad *load = dynamic_cast<InstructionLoad *>(raw_inst)) {
+				ExprKey key = this->make_load_key(table, load->get_location());
+				this->number_computation(table, inst, *get_def(*raw_inst), mv(key));
+			} else if (InstructionLength *length = dynamic_cast<InstructionLength *>(raw_inst)) {
+				ExprKey key = this->make_length_key(table, length->get_length());
+				this->number_computation(table, inst, *get_def(*raw_inst), mv(key));
+			} else if (InstructionStore *store = dynamic_cast<InstructionStore *>(raw_inst)) {
+				MemoryLocation &location = store->get_location();
+				this->clobber_memory(table, this->get_memory_class(*location.get_base().get_referent()));
+				// a load right after the store will read the stored value
+				ExprKey key = this->make_load_key(table, location);
+				table.exprs.insert_or_assign(key, NumberedValue {
+					this->get_number(table, store->get_source()),
+					get_variable(store->get_source())
+				});
+			} else if (Opt<Variable *> dest = get_def(*raw_inst)) {
+				// a new array
+				this->clobber_memory(table, this->get_memory_class(*dest));
+				table.var_numbers[*dest] = this->new_number();
+			}
+		}
+
+		void visit(BasicBlock &bb, ValueTable table) {
+			auto effects_it = this->region_effects.find(&bb);
+			if (effects_it != this->region_effects.end()) {
+				for (Variable *var : effects_it->second.defs) {
+					table.var_numbers[var] = this->new_number();
+				}
+				for (Variable *memory_class : effects_it->second.clobbered_memory) {
+					this->clobber_memory(table, memory_class);
+				}
+			}
+
+			Vec<Uptr<Instruction>> &insts = bb.get_inst();
+			for (Uptr<Instruction> &inst : insts) {
+				this->number_instruction(table, inst);
+			}
+			insts.erase(
+				std::remove_if(insts.begin(), insts.end(), [](const Uptr<Instruction> &inst) { return !inst; }),
+				insts.end()
+			);
+
+			const Vec<BasicBlock *> &children = this->dominators.get_children(&bb);
+			for (BasicBlock *child : children) {
+				this->visit(*child, table);
+			}
+		}
+
+		// For each block, finds what might change between the end of its
+		// immediate dominator and its start: the effects of every block on
+		// a path between them (which includes the block itself if it is in
+		// a loop that doesn't go through the dominator)
+		void find_region_effects(IRFunction &ir_function) {
+			Map<BasicBlock *, Vec<BasicBlock *>> predecessors = cfg::get_predecessors(ir_function);
+			Map<BasicBlock *, RegionEffects> block_effects;
+			for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+				RegionEffects &effects = block_effects[block.get()];
+				for (const Uptr<Instruction> &inst : block->get_inst()) {
+					if (Opt<Variable *> def = get_def(*inst)) {
+						effects.defs.insert(*def);
+					}
+					if (dynamic_cast<InstructionStore *>(inst.get())) {
+						effects.clobbered_memory.insert(this->get_memory_class(*(*inst->get_accessed_array())->get_referent()));
+					} else if (dynamic_cast<InstructionInitializeArray *>(inst.get())) {
+						effects.clobbered_memory.insert(this->get_memory_class(*get_def(*inst)));
+					} else if (InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(inst.get())) {
+						FunctionCall *call = dynamic_cast<FunctionCall *>(assignment->get_source().get());
+						if (call && call_graph::get_call_summary(*call, this->summaries).writes_memory) {
+							effects.clobbered_memory.insert(nullptr);
+						}
+					}
+				}
+			}
+			for (const Uptr<BasicBlock> &block : ir_function.get_blocks()) {
+				Opt<BasicBlock *> idom = this->dominators.get_idom(block.get());
+				if (!idom) {
+					continue;
+				}
+				RegionEffects &effects = this->region_effects[block.get()];
+				Set<BasicBlock *> visited;
+				Vec<BasicBlock *> stack = predecessors.at(block.get());
+				while (!stack.empty()) {
+					BasicBlock *region_block = stack.back();
+					stack.pop_back();
+					if (region_block == *idom || !visited.insert(region_block).second) {
+						continue;
+					}
+					effects.defs += block_effects.at(region_block).defs;
+					effects.clobbered_memory += block_effects.at(region_block).clobbered_memory;
+					stack += predecessors.at(region_block);
+				}
+			}
+		}
+	};
+
+	bool eliminate_common_subexpressions(IRFunction &ir_function, const call_graph::SummaryMap &summaries) {
+		cfg::DominatorTree dominators = cfg::make_dominator_tree(ir_function);
+		ValueNumberer numberer(ir_function, dominators, summaries);
+		return numberer.run(ir_function);
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+#include "call_graph.h"
+
+namespace IR::optimizer {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// Global value numbering over the dominator tree. Operations, lengths
+	// and loads that compute a value already held by some variable (or a
+	// known constant) in a dominating instruction are replaced with a copy
+	// of that value. Loads are only reused while no store or call that could
+	// write to them has happened in between. Returns whether the function
+	// was changed.
+	bool eliminate_common_subexpressions(IRFunction &ir_function, const call_graph::SummaryMap &summaries);
+}
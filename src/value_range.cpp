@@ -0,0 +1,379 @@
+#include "value_range.h"
+#include "analysis.h"
+#include "cfg.h"
+#include <limits>
+
+namespace IR::analysis {
+	const int64_t min_value = std::numeric_limits<int64_t>::min();
+	const int64_t max_value = std::numeric_limits<int64_t>::max();
+
+	// a loop header whose entry ranges have grown this many times is
+	// assumed to be in a loop that keeps growing them
+	const int widening_threshold = 2;
+
+	Range Range::full() {
+		return { min_value, max_value };
+	}
+	Range Range::empty() {
+		return { max_value, min_value };
+	}
+	Range Range::constant(int64_t value) {
+		return { value, value };
+	}
+	Range Range::join(const Range &other) const {
+		if (this->is_empty()) {
+			return other;
+		}
+		if (other.is_empty()) {
+			return *this;
+		}
+		return { std::min(this->min, other.min), std::max(this->max, other.max) };
+	}
+	Range Range::intersect(const Range &other) const {
+		return { std::max(this->min, other.min), std::min(this->max, other.max) };
+	}
+
+	Range evaluate_range(Operator op, const Range &lhs, const Range &rhs) {
+		if (lhs.is_empty() || rhs.is_empty()) {
+			return Range::empty();
+		}
+		int64_t low, high;
+		switch (op) {
+			case Operator::plus:
+				if (__builtin_add_overflow(lhs.min, rhs.min, &low) || __builtin_add_overflow(lhs.max, rhs.max, &high)) {
+					return Range::full();
+				}
+				return { low, high };
+			case Operator::minus:
+				if (__builtin_sub_overflow(lhs.min, rhs.max, &low) || __builtin_sub_overflow(lhs.max, rhs.min, &high)) {
+					return Range::full();
+				}
+				return { low, high };
+			case Operator::times: {
+				int64_t products[4];
+				if (__builtin_mul_overflow(lhs.min, rhs.min, &products[0])
+					|| __builtin_mul_overflow(lhs.min, rhs.max, &products[1])
+					|| __builtin_mul_overflow(lhs.max, rhs.min, &products[2])
+					|| __builtin_mul_overflow(lhs.max, rhs.max, &products[3]))
+				{
+					return Range::full();
+				}
+				return { *std::min_element(products, products + 4), *std::max_element(products, products + 4) };
+			}
+			case Operator::bitwise_and:
+				// and-ing with a non-negative value can only clear bits
+				if (lhs.min >= 0 && rhs.min >= 0) {
+					return { 0, std::min(lhs.max, rhs.max) };
+				}
+				if (lhs.min >= 0) {
+					return { 0, lhs.max };
+				}
+				if (rhs.min >= 0) {
+					return { 0, rhs.max };
+				}
+				return Range::full();
+			case Operator::lshift: {
+				if (rhs.min != rhs.max) {
+					return Range::full();
+				}
+				int64_t shift = rhs.min & 63;
+				if (lhs.min < (min_value >> shift) || lhs.max > (max_value >> shift)) {
+					return Range::full();
+				}
+				return {
+					evaluate_operator(Operator::lshift, lhs.min, shift),
+					evaluate_operator(Operator::lshift, lhs.max, shift)
+				};
+			}
+			case Operator::rshift:
+				if (rhs.min < 0 || rhs.max > 63) {
+					return Range::full();
+				}
+				return {
+					lhs.min >> (lhs.min >= 0 ? rhs.max : rhs.min),
+					lhs.max >> (lhs.max >= 0 ? rhs.min : rhs.max)
+				};
+			default:
+				if (Opt<bool> outcome = decide_comparison(op, lhs, rhs)) {
+					return Range::constant(*outcome);
+				}
+				return { 0, 1 };
+		}
+	}
+
+	Opt<bool> decide_comparison(Operator op, const Range &lhs, const Range &rhs) {
+		switch (op) {
+			case Operator::lt:
+				if (lhs.max < rhs.min) {
+					return true;
+				}
+				if (lhs.min >= rhs.max) {
+					return false;
+				}
+				return {};
+			case Operator::le:
+				if (lhs.max <= rhs.min) {
+					return true;
+				}
+				if (lhs.min > rhs.max) {
+					return false;
+				}
+				return {};
+			case Operator::eq:
+				if (lhs.min == lhs.max && rhs.min == rhs.max && lhs.min == rhs.min) {
+					return true;
+				}
+				if (lhs.max < rhs.min || rhs.max < lhs.min) {
+					return false;
+				}
+				return {};
+			case Operator::ge:
+			case Operator::gt:
+				return decide_comparison(*flip_operator(op), rhs, lhs);
+			default:
+				return {};
+		}
+	}
+
+	Range get_range(const Uptr<Expr> &expr, const RangeMap &ranges) {
+		if (Opt<int64_t> number = get_number(expr)) {
+			return Range::constant(*number);
+		}
+		if (Opt<Variable *> var = get_variable(expr)) {
+			auto it = ranges.find(*var);
+			if (it != ranges.end()) {
+				return it->second;
+			}
+		}
+		return Range::full();
+	}
+
+	void set_range(Variable *var, const Range &range, RangeMap &ranges) {
+		if (range == Range::full()) {
+			ranges.erase(var);
+		} else {
+			ranges.insert_or_assign(var, range);
+		}
+	}
+
+	void transfer_ranges(Instruction &inst, RangeMap &ranges) {
+		Opt<Variable *> def = get_def(inst);
+		if (!def) {
+			return;
+		}
+		Range range = Range::full();
+		if (InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(&inst)) {
+			Uptr<Expr> &source = assignment->get_source();
+			if (BinaryOperation *bin_op = dynamic_cast<BinaryOperation *>(source.get())) {
+				range = evaluate_range(
+					bin_op->get_operator(),
+					get_range(bin_op->get_lhs(), ranges),
+					get_range(bin_op->get_rhs(), ranges)
+				);
+			} else if (!dynamic_cast<FunctionCall *>(source.get())) {
+				range = get_range(source, ranges);
+			}
+		} else if (InstructionLength *length = dynamic_cast<InstructionLength *>(&inst)) {
+			// the number of elements, encoded
+			if (!length->get_length().get_dim()) {
+				range = { 1, max_value };
+			}
+		}
+		set_range(*def, range, ranges);
+	}
+
+	// Narrows the ranges of the operands of a comparison to the values for
+	// which it has the given outcome. Returns false if it can't have it.
+	bool refine_comparison(Operator op, const Uptr<Expr> &lhs, const Uptr<Expr> &rhs, bool outcome, RangeMap &ranges) {
+		Range lhs_range = get_range(lhs, ranges);
+		Range rhs_range = get_range(rhs, ranges);
+		if (!outcome) {
+			Opt<Operator> negated = negate_operator(op);
+			if (!negated) {
+				// being unequal only rules out a single value, which the
+				// ranges can't express unless it's one of their bounds
+				return decide_comparison(op, lhs_range, rhs_range) != true;
+			}
+			op = *negated;
+		}
+		Range new_lhs = lhs_range;
+		Range new_rhs = rhs_range;
+		switch (op) {
+			case Operator::lt:
+				if (rhs_range.max == min_value || lhs_range.min == max_value) {
+					return false;
+				}
+				new_lhs.max = std::min(lhs_range.max, rhs_range.max - 1);
+				new_rhs.min = std::max(rhs_range.min, lhs_range.min + 1);
+				break;
+			case Operator::le:
+				new_lhs.max = std::min(lhs_range.max, rhs_range.max);
+				new_rhs.min = std::max(rhs_range.min, lhs_range.min);
+				break;
+			case Operator::eq:
+				new_lhs = lhs_range.intersect(rhs_range);
+				new_rhs = new_lhs;
+				break;
+			case Operator::ge:
+			case Operator::gt:
+				return refine_comparison(*flip_operator(op), rhs, lhs, true, ranges);
+			default:
+				return true;
+		}
+		if (new_lhs.is_empty() || new_rhs.is_empty()) {
+			return false;
+		}
+		if (Opt<Variable *> var = get_variable(lhs)) {
+			set_range(*var, new_lhs, ranges);
+		}
+		if (Opt<Variable *> var = get_variable(rhs)) {
+			set_range(*var, new_rhs, ranges);
+		}
+		return true;
+	}
+
+	// returns the comparison which computed the value a variable has at
+	// the end of the block, if its operands still hold the values it
+	// compared
+	Opt<BinaryOperation *> get_final_comparison(BasicBlock &bb, Variable *var) {
+		Set<Variable *> defined_after;
+		Vec<Uptr<Instruction>> &insts = bb.get_inst();
+		for (auto it = insts.rbegin(); it != insts.rend(); ++it) {
+			Opt<Variable *> def = get_def(**it);
+			if (!def) {
+				continue;
+			}
+			if (*def == var) {
+				InstructionAssignment *assignment = dynamic_cast<InstructionAssignment *>(it->get());
+				BinaryOperation *bin_op = assignment ? dynamic_cast<BinaryOperation *>(assignment->get_source().get()) : nullptr;
+				if (!bin_op || !is_comparison(bin_op->get_operator())) {
+					return {};
+				}
+				for (Uptr<Expr> *operand : { &bin_op->get_lhs(), &bin_op->get_rhs() }) {
+					Opt<Variable *> operand_var = get_variable(*operand);
+					if (operand_var && (*operand_var == var || defined_after.count(*operand_var))) {
+						return {};
+					}
+				}
+				return bin_op;
+			}
+			defined_after.insert(*def);
+		}
+		return {};
+	}
+
+	// Returns the ranges along the edge to the successor at the given index,
+	// narrowed by the branch condition, or nothing if the condition rules
+	// the edge out.
+	Opt<RangeMap> get_edge_ranges(BasicBlock &bb, const RangeMap &exit_ranges, int successor_index) {
+		RangeMap ranges = exit_ranges;
+		if (!dynamic_cast<TerminatorBranchTwo *>(bb.get_terminator().get())) {
+			return ranges;
+		}
+		bool outcome = successor_index == 0;
+		Uptr<Expr> &condition = *bb.get_terminator()->get_operands()[0];
+		Range condition_range = get_range(condition, ranges);
+		Opt<Variable *> condition_var = get_variable(condition);
+		if (outcome) {
+			// anything but 0 is true
+			if (condition_range.min == 0) {
+				condition_range.min = 1;
+			}
+			if (condition_range.max == 0) {
+				condition_range.max = -1;
+			}
+		} else {
+			condition_range = condition_range.intersect(Range::constant(0));
+		}
+		if (condition_range.is_empty()) {
+			return {};
+		}
+		if (!condition_var) {
+			return ranges;
+		}
+		set_range(*condition_var, condition_range, ranges);
+		if (Opt<BinaryOperation *> comparison = get_final_comparison(bb, *condition_var)) {
+			BinaryOperation &bin_op = **comparison;
+			if (!refine_comparison(bin_op.get_operator(), bin_op.get_lhs(), bin_op.get_rhs(), outcome, ranges)) {
+				return {};
+			}
+		}
+		return ranges;
+	}
+
+	// Joins the incoming ranges into the existing ones. When widening, a
+	// bound that grows goes straight to the extreme instead. Returns
+	// whether dest changed.
+	bool join_into(RangeMap &dest, const RangeMap &incoming, bool widen) {
+		bool changed = false;
+		for (auto it = dest.begin(); it != dest.end();) {
+			auto incoming_it = incoming.find(it->first);
+			if (incoming_it == incoming.end()) {
+				it = dest.erase(it);
+				changed = true;
+				continue;
+			}
+			Range joined = it->second.join(incoming_it->second);
+			if (joined != it->second) {
+				if (widen) {
+					joined = {
+						joined.min < it->second.min ? min_value : joined.min,
+						joined.max > it->second.max ? max_value : joined.max
+					};
+				}
+				changed = true;
+			}
+			if (joined == Range::full()) {
+				it = dest.erase(it);
+			} else {
+				it->second = joined;
+				++it;
+			}
+		}
+		return changed;
+	}
+
+	Map<BasicBlock *, RangeMap> compute_value_ranges(IRFunction &ir_function) {
+		// every cycle goes through the target of a retreating edge, so
+		// widening only there is enough to stop
+		Set<BasicBlock *> loop_headers;
+		for (const auto &[from, to] : cfg::get_retreating_edges(ir_function)) {
+			loop_headers.insert(to);
+		}
+		Map<BasicBlock *, RangeMap> entry_ranges;
+		Map<BasicBlock *, int> growth_counts;
+		BasicBlock *entry_block = ir_function.get_blocks()[0].get();
+		entry_ranges.emplace(entry_block, RangeMap {});
+		Vec<BasicBlock *> worklist = { entry_block };
+		while (!worklist.empty()) {
+			BasicBlock *bb = worklist.back();
+			worklist.pop_back();
+
+			RangeMap ranges = entry_ranges.at(bb);
+			for (Uptr<Instruction> &inst : bb->get_inst()) {
+				transfer_ranges(*inst, ranges);
+			}
+			Vec<Pair<BasicBlock *, double>> successors = bb->get_terminator()->get_successor();
+			for (int i = 0; i < successors.size(); ++i) {
+				BasicBlock *succ = successors[i].first;
+				Opt<RangeMap> edge_ranges = get_edge_ranges(*bb, ranges, i);
+				if (!edge_ranges) {
+					continue;
+				}
+				auto succ_it = entry_ranges.find(succ);
+				if (succ_it == entry_ranges.end()) {
+					entry_ranges.emplace(succ, mv(*edge_ranges));
+					worklist.push_back(succ);
+				} else if (join_into(
+					succ_it->second,
+					*edge_ranges,
+					loop_headers.count(succ) && growth_counts[succ] >= widening_threshold
+				)) {
+					growth_counts[succ] += 1;
+					worklist.push_back(succ);
+				}
+			}
+		}
+		return entry_ranges;
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "std_alias.h"
+#include "program.h"
+
+namespace IR::analysis {
+	using namespace std_alias;
+	using namespace IR::program;
+
+	// The smallest and largest value something may hold. The range is
+	// empty if min > max.
+	struct Range {
+		int64_t min;
+		int64_t max;
+
+		static Range full();
+		static Range empty();
+		static Range constant(int64_t value);
+		bool is_empty() const { return this->min > this->max; }
+		bool contains(int64_t value) const { return this->min <= value && value <= this->max; }
+		// the smallest range containing both
+		Range join(const Range &other) const;
+		// the values in both
+		Range intersect(const Range &other) const;
+		bool operator==(const Range &other) const { return this->min == other.min && this->max == other.max; }
+		bool operator!=(const Range &other) const { return !(*this == other); }
+	};
+
+	// returns the range `lhs op rhs` falls into, given the ranges of the
+	// operands
+	Range evaluate_range(Operator op, const Range &lhs, const Range &rhs);
+
+	// returns whether a comparison is always true or always false, given
+	// the ranges of its operands
+	Opt<bool> decide_comparison(Operator op, const Range &lhs, const Range &rhs);
+
+	// maps each variable to the range of values it may hold at a point in
+	// the function. a variable missing from the map may hold any value
+	using RangeMap = Map<Variable *, Range>;
+	Range get_range(const Uptr<Expr> &expr, const RangeMap &ranges);
+	void transfer_ranges(Instruction &inst, RangeMap &ranges);
+
+	// Returns the ranges at the start of each block, found by propagating
+	// them forward and narrowing them along each edge of a branch by what
+	// its condition says. Loops are widened to ensure termination. A block
+	// missing from the result can never be reached, as no path to it is
+	// consistent with the branch conditions.
+	Map<BasicBlock *, RangeMap> compute_value_ranges(IRFunction &ir_function);
+}